@@ -0,0 +1,138 @@
+#include "archive.hpp"
+
+#include <stdexcept>
+
+#include "checksum.hpp"
+#include "inflate.hpp"
+
+namespace
+{
+constexpr uint32_t kLocalHeader = 0x04034b50;
+constexpr uint32_t kCentralHeader = 0x02014b50;
+constexpr uint32_t kEndOfDirectory = 0x06054b50;
+
+constexpr std::size_t kLocalHeaderSize = 30;
+constexpr std::size_t kCentralHeaderSize = 46;
+constexpr std::size_t kEndOfDirectorySize = 22;
+// The end record may be followed by a comment of up to 64 KiB.
+constexpr std::size_t kMaxCommentSize = 0xffff;
+
+constexpr uint16_t kStored = 0;
+constexpr uint16_t kDeflated = 8;
+
+// Zip fields are little-endian, unlike the rest of the class file world.
+uint16_t L2(const std::span<const uint8_t> bytes, const std::size_t pos)
+{
+  return bytes[pos] | (bytes[pos + 1] << 8);
+}
+
+uint32_t L4(const std::span<const uint8_t> bytes, const std::size_t pos)
+{
+  return L2(bytes, pos) | (static_cast<uint32_t>(L2(bytes, pos + 2)) << 16);
+}
+}
+
+CppDuke::Archive::Archive(const std::string &path)
+    : _path(path),
+      _file(ClassFile::Map(path))
+{
+  const std::span<const uint8_t> kBytes = _file.Bytes();
+  if (kBytes.size() < kEndOfDirectorySize)
+  {
+    throw std::invalid_argument("Not a zip archive: " + path);
+  }
+
+  std::size_t end = kBytes.size() - kEndOfDirectorySize;
+  const std::size_t kLowest = end > kMaxCommentSize ? end - kMaxCommentSize : 0;
+  while (L4(kBytes, end) != kEndOfDirectory)
+  {
+    if (end == kLowest)
+    {
+      throw std::invalid_argument("Not a zip archive: " + path);
+    }
+    end--;
+  }
+
+  // Zip64 archives mark these as 0xffff and 0xffffffff, they are not
+  // supported.
+  const uint16_t kCount = L2(kBytes, end + 10);
+  const uint32_t kSize = L4(kBytes, end + 12);
+  const uint32_t kOffset = L4(kBytes, end + 16);
+  if (kOffset > end || kSize > end - kOffset)
+  {
+    throw std::invalid_argument("Damaged zip directory: " + path);
+  }
+
+  _entries.reserve(kCount);
+  std::size_t pos = kOffset;
+  for (uint16_t i = 0; i < kCount; i++)
+  {
+    if (pos + kCentralHeaderSize > kOffset + kSize || L4(kBytes, pos) != kCentralHeader)
+    {
+      throw std::invalid_argument("Damaged zip directory: " + path);
+    }
+
+    const uint16_t kNameLength = L2(kBytes, pos + 28);
+    const std::size_t kNext = pos + kCentralHeaderSize + kNameLength + L2(kBytes, pos + 30) + L2(kBytes, pos + 32);
+    if (kNext > kOffset + kSize)
+    {
+      throw std::invalid_argument("Damaged zip directory: " + path);
+    }
+
+    _entries.push_back(Entry{std::string{reinterpret_cast<const char *>(&kBytes[pos + kCentralHeaderSize]), kNameLength},
+                             L4(kBytes, pos + 42),
+                             L4(kBytes, pos + 20),
+                             L4(kBytes, pos + 24),
+                             L4(kBytes, pos + 16),
+                             L2(kBytes, pos + 10)});
+    pos = kNext;
+  }
+}
+
+const std::vector<CppDuke::Archive::Entry> &CppDuke::Archive::Entries() const
+{
+  return _entries;
+}
+
+std::vector<uint8_t> CppDuke::Archive::Extract(const Entry &entry) const
+{
+  // Data follows the local header, whose name and extra field may differ in
+  // length from those in the central directory.
+  const std::span<const uint8_t> kBytes = _file.Bytes();
+  if (entry.offset > kBytes.size() - kLocalHeaderSize || L4(kBytes, entry.offset) != kLocalHeader)
+  {
+    throw std::invalid_argument("Damaged zip entry: " + _path + "!" + entry.name);
+  }
+
+  const std::size_t kStart = entry.offset + kLocalHeaderSize + L2(kBytes, entry.offset + 26) + L2(kBytes, entry.offset + 28);
+  if (kStart > kBytes.size() || entry.compressedSize > kBytes.size() - kStart)
+  {
+    throw std::invalid_argument("Damaged zip entry: " + _path + "!" + entry.name);
+  }
+
+  const std::span<const uint8_t> kData = kBytes.subspan(kStart, entry.compressedSize);
+  std::vector<uint8_t> extracted;
+  switch (entry.method)
+  {
+    case kStored:
+      if (entry.compressedSize != entry.size)
+      {
+        throw std::invalid_argument("Damaged zip entry: " + _path + "!" + entry.name);
+      }
+      extracted.assign(kData.begin(), kData.end());
+      break;
+    case kDeflated:
+      extracted = Inflate(kData, entry.size);
+      break;
+    default:
+      throw std::invalid_argument("Unsupported compression in " + _path + "!" + entry.name);
+  }
+
+  // A damaged entry may still come out at the right length.
+  if (Crc32(extracted) != entry.crc)
+  {
+    throw std::invalid_argument("Damaged zip entry: " + _path + "!" + entry.name);
+  }
+
+  return extracted;
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "classfile.hpp"
+
+namespace CppDuke
+{
+// A zip archive such as a JAR. Only the central directory is read when it is
+// opened, entries are extracted one at a time when asked for. Extraction
+// does not change the archive, so it may happen on several threads at once.
+class Archive
+{
+public:
+  struct Entry
+  {
+    std::string name;
+    uint32_t offset, compressedSize, size;
+    // CRC-32 of the uncompressed contents, as recorded in the directory.
+    uint32_t crc;
+    uint16_t method;
+  };
+
+private:
+  std::string _path;
+  // The whole archive, mapped read only.
+  ClassFile _file;
+  std::vector<Entry> _entries;
+
+public:
+  // Throws std::invalid_argument if path is not a readable zip archive.
+  explicit Archive(const std::string &path);
+
+  const std::vector<Entry> &Entries() const;
+
+  // Stored or deflated contents of entry, throws if they are neither or are
+  // damaged.
+  std::vector<uint8_t> Extract(const Entry &entry) const;
+};
+}
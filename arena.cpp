@@ -0,0 +1,70 @@
+#include "arena.hpp"
+
+#include <algorithm>
+#include <cstdint>
+
+CppDuke::Arena::Arena(const std::size_t chunkSize)
+    : _next(nullptr),
+      _end(nullptr),
+      _chunkSize(chunkSize),
+      _reserved(0),
+      _used(0)
+{
+}
+
+CppDuke::Arena::Arena(Arena &&other) noexcept
+    : _chunks(std::move(other._chunks)),
+      _next(std::exchange(other._next, nullptr)),
+      _end(std::exchange(other._end, nullptr)),
+      _chunkSize(other._chunkSize),
+      _reserved(std::exchange(other._reserved, 0)),
+      _used(std::exchange(other._used, 0))
+{
+}
+
+CppDuke::Arena &CppDuke::Arena::operator=(Arena &&other) noexcept
+{
+  _chunks = std::move(other._chunks);
+  _next = std::exchange(other._next, nullptr);
+  _end = std::exchange(other._end, nullptr);
+  _chunkSize = other._chunkSize;
+  _reserved = std::exchange(other._reserved, 0);
+  _used = std::exchange(other._used, 0);
+  return *this;
+}
+
+void *CppDuke::Arena::Allocate(const std::size_t size, const std::size_t align)
+{
+  const uintptr_t kStart = (reinterpret_cast<uintptr_t>(_next) + align - 1) & ~(align - 1);
+  if (_next == nullptr || kStart + size > reinterpret_cast<uintptr_t>(_end))
+  {
+    return _Grow(size, align);
+  }
+
+  _next = reinterpret_cast<std::byte *>(kStart + size);
+  _used += size;
+  return reinterpret_cast<void *>(kStart);
+}
+
+void *CppDuke::Arena::_Grow(const std::size_t size, const std::size_t align)
+{
+  // new[] aligns for any fundamental type, align only matters past that.
+  const std::size_t kSize = std::max(_chunkSize, size + align);
+  _chunks.push_back(std::make_unique_for_overwrite<std::byte[]>(kSize));
+  _next = _chunks.back().get();
+  _end = _next + kSize;
+  _reserved += kSize;
+  _chunkSize *= 2;
+
+  return Allocate(size, align);
+}
+
+std::size_t CppDuke::Arena::Reserved() const
+{
+  return _reserved;
+}
+
+std::size_t CppDuke::Arena::Used() const
+{
+  return _used;
+}
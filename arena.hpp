@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace CppDuke
+{
+// Bump allocator for memory that lives exactly as long as its owner, such as
+// the metadata of a class. Nothing is freed on its own, all of it goes at
+// once with the arena, so only trivially destructible types may be placed in
+// it. Not thread safe.
+class Arena
+{
+  std::vector<std::unique_ptr<std::byte[]>> _chunks;
+  std::byte *_next, *_end;
+  std::size_t _chunkSize, _reserved, _used;
+
+  void *_Grow(std::size_t size, std::size_t align);
+
+public:
+  // The first chunk is chunkSize bytes, later ones double.
+  explicit Arena(std::size_t chunkSize = 4096);
+  Arena(Arena &&other) noexcept;
+  Arena &operator=(Arena &&other) noexcept;
+  Arena(const Arena &) = delete;
+  Arena &operator=(const Arena &) = delete;
+
+  void *Allocate(std::size_t size, std::size_t align);
+
+  // Uninitialized room for count objects of _Ty.
+  template<typename _Ty>
+  _Ty *Allocate(const std::size_t count)
+  {
+    static_assert(std::is_trivially_destructible_v<_Ty>);
+    return static_cast<_Ty *>(Allocate(sizeof(_Ty) * count, alignof(_Ty)));
+  }
+
+  template<typename _Ty, typename... _Args>
+  _Ty *New(_Args &&... args)
+  {
+    return new(Allocate<_Ty>(1)) _Ty(std::forward<_Args>(args)...);
+  }
+
+  // Bytes taken from the heap, and how many of them were handed out.
+  std::size_t Reserved() const;
+  std::size_t Used() const;
+};
+}
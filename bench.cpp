@@ -0,0 +1,231 @@
+// Runs a tight integer loop on the two slot representations the interpreter
+// has had: std::any operands and locals, as Frame held them before Value,
+// and Value slots in one flat array, as they are now. Both go through the
+// same switch over the same bytecode, so only the slots differ.
+//
+//   int sum = 0;
+//   for (int i = 0; i < n; i++)
+//     sum += i;
+
+#include <any>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <stack>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "value.hpp"
+
+using namespace CppDuke::VirtualMachine;
+
+namespace
+{
+typedef enum : uint8_t
+{
+  ICONST_0 = 0x03,
+  ILOAD_0 = 0x1a,
+  ILOAD_1,
+  ILOAD_2,
+  ISTORE_1 = 0x3c,
+  ISTORE_2,
+  IADD = 0x60,
+  IINC = 0x84,
+  IF_ICMPGE = 0xa2,
+  GOTO = 0xa7,
+  IRETURN = 0xac,
+} Opcode;
+
+// Local 0 is n, 1 is sum and 2 is i.
+constexpr uint8_t kLoop[] = {
+    ICONST_0, ISTORE_1,
+    ICONST_0, ISTORE_2,
+    ILOAD_2, ILOAD_0, IF_ICMPGE, 0, 13,
+    ILOAD_1, ILOAD_2, IADD, ISTORE_1,
+    IINC, 2, 1,
+    GOTO, 0xff, 0xf4,
+    ILOAD_1, IRETURN,
+};
+
+// Frame as it was: a std::stack and a std::vector of std::any, every access
+// a copy and every read an any_cast.
+class AnyFrame
+{
+  std::stack<std::any> _stack;
+  std::vector<std::any> _locals;
+
+public:
+  explicit AnyFrame(const uint16_t locals)
+  {
+    _locals.resize(locals + 1);
+  }
+
+  std::any At(const int pos) const
+  {
+    return _locals[pos];
+  }
+
+  std::any Pop()
+  {
+    std::any top = _stack.top();
+    _stack.pop();
+    return top;
+  }
+
+  void Push(const std::any &item)
+  {
+    _stack.emplace(item);
+  }
+
+  void Set(const int pos, const std::any val)
+  {
+    if (!val.has_value())
+    {
+      throw std::invalid_argument("Value is empty for position " + std::to_string(pos));
+    }
+
+    _locals[pos] = val;
+  }
+
+  int32_t Int(const std::any &v) const
+  {
+    return std::any_cast<int32_t>(v);
+  }
+};
+
+// Value slots: locals first, then the operand area, as the interpreter
+// lays out a frame on its stack.
+class ValueFrame
+{
+  std::vector<Value> _slots;
+  Value *_sp;
+
+public:
+  explicit ValueFrame(const uint16_t locals) : _slots(locals + 16), _sp(_slots.data() + locals)
+  {}
+
+  Value At(const int pos) const
+  {
+    return _slots[pos];
+  }
+
+  Value Pop()
+  {
+    return *--_sp;
+  }
+
+  void Push(const Value v)
+  {
+    *_sp++ = v;
+  }
+
+  void Set(const int pos, const Value v)
+  {
+    _slots[pos] = v;
+  }
+
+  int32_t Int(const Value v) const
+  {
+    return v.As<int32_t>();
+  }
+};
+
+template<typename _Frame, typename _Make>
+int32_t Run(const int32_t n, _Make make, uint64_t &executed)
+{
+  _Frame frame(3);
+  frame.Set(0, make(n));
+  std::size_t pc = 0;
+  for (;;)
+  {
+    executed++;
+    switch (kLoop[pc])
+    {
+      case ICONST_0:
+        frame.Push(make(0));
+        pc++;
+        break;
+      case ILOAD_0:
+      case ILOAD_1:
+      case ILOAD_2:
+        frame.Push(make(frame.Int(frame.At(kLoop[pc] - ILOAD_0))));
+        pc++;
+        break;
+      case ISTORE_1:
+      case ISTORE_2:
+        frame.Set(kLoop[pc] - ISTORE_1 + 1, make(frame.Int(frame.Pop())));
+        pc++;
+        break;
+      case IADD:
+      {
+        const int32_t kV2 = frame.Int(frame.Pop());
+        const int32_t kV1 = frame.Int(frame.Pop());
+        frame.Push(make(static_cast<int32_t>(static_cast<uint32_t>(kV1) + static_cast<uint32_t>(kV2))));
+        pc++;
+        break;
+      }
+      case IINC:
+        frame.Set(kLoop[pc + 1], make(frame.Int(frame.At(kLoop[pc + 1])) + static_cast<int8_t>(kLoop[pc + 2])));
+        pc += 3;
+        break;
+      case IF_ICMPGE:
+      {
+        const int32_t kV2 = frame.Int(frame.Pop());
+        const int32_t kV1 = frame.Int(frame.Pop());
+        pc = kV1 >= kV2 ? pc + static_cast<int16_t>(kLoop[pc + 1] << 8 | kLoop[pc + 2]) : pc + 3;
+        break;
+      }
+      case GOTO:
+        pc += static_cast<int16_t>(kLoop[pc + 1] << 8 | kLoop[pc + 2]);
+        break;
+      case IRETURN:
+        return frame.Int(frame.Pop());
+      default:
+        throw std::invalid_argument("Invalid opcode: " + std::to_string(kLoop[pc]));
+    }
+  }
+}
+
+// Best of runs, in nanoseconds per instruction.
+template<typename _Frame, typename _Make>
+double Measure(const int32_t n, const int runs, _Make make, int32_t &result)
+{
+  double best = 0;
+  for (int i = 0; i < runs; i++)
+  {
+    uint64_t executed = 0;
+    const auto kStart = std::chrono::steady_clock::now();
+    result = Run<_Frame>(n, make, executed);
+    const std::chrono::duration<double, std::nano> kElapsed = std::chrono::steady_clock::now() - kStart;
+    const double kPer = kElapsed.count() / executed;
+    if (i == 0 || kPer < best)
+    {
+      best = kPer;
+    }
+  }
+
+  return best;
+}
+}
+
+int main(int argc, char **argv)
+{
+  const int32_t kN = argc > 1 ? std::stoi(argv[1]) : 10000000;
+  const int kRuns = 5;
+
+  int32_t anyResult, valueResult;
+  const double kAny = Measure<AnyFrame>(kN, kRuns, [](const int32_t v) { return std::any{v}; }, anyResult);
+  const double kValue = Measure<ValueFrame>(kN, kRuns, [](const int32_t v) { return Value::From(v); }, valueResult);
+  if (anyResult != valueResult)
+  {
+    fprintf(stderr, "Results differ: %d and %d\n", anyResult, valueResult);
+    return 1;
+  }
+
+  printf("Loop of %d iterations, best of %d runs\n", kN, kRuns);
+  printf("std::any slots: %.2f ns per instruction\n", kAny);
+  printf("Value slots:    %.2f ns per instruction\n", kValue);
+  printf("Speedup:        %.1fx\n", kAny / kValue);
+  return 0;
+}
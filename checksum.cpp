@@ -0,0 +1,64 @@
+#include "checksum.hpp"
+
+#include <array>
+#include <bit>
+#include <cstring>
+
+namespace
+{
+// Reflected polynomial of ISO 3309. Row 0 advances the CRC by one byte, row
+// k by one byte followed by k zero bytes, so eight bytes are folded in with
+// eight independent lookups.
+constexpr std::array<std::array<uint32_t, 256>, 8> MakeTables()
+{
+  std::array<std::array<uint32_t, 256>, 8> tables{};
+  for (uint32_t i = 0; i < 256; i++)
+  {
+    uint32_t c = i;
+    for (int k = 0; k < 8; k++)
+    {
+      c = c & 1 ? 0xedb88320u ^ (c >> 1) : c >> 1;
+    }
+    tables[0][i] = c;
+  }
+
+  for (std::size_t k = 1; k < tables.size(); k++)
+  {
+    for (uint32_t i = 0; i < 256; i++)
+    {
+      tables[k][i] = tables[0][tables[k - 1][i] & 0xff] ^ (tables[k - 1][i] >> 8);
+    }
+  }
+
+  return tables;
+}
+
+constexpr std::array<std::array<uint32_t, 256>, 8> kTables = MakeTables();
+}
+
+uint32_t CppDuke::Crc32(const std::span<const uint8_t> bytes)
+{
+  uint32_t c = 0xffffffffu;
+  std::size_t i = 0;
+  if constexpr (std::endian::native == std::endian::little)
+  {
+    for (; i + 8 <= bytes.size(); i += 8)
+    {
+      uint32_t low, high;
+      std::memcpy(&low, &bytes[i], sizeof(low));
+      std::memcpy(&high, &bytes[i + 4], sizeof(high));
+      low ^= c;
+      c = kTables[7][low & 0xff] ^ kTables[6][(low >> 8) & 0xff]
+          ^ kTables[5][(low >> 16) & 0xff] ^ kTables[4][low >> 24]
+          ^ kTables[3][high & 0xff] ^ kTables[2][(high >> 8) & 0xff]
+          ^ kTables[1][(high >> 16) & 0xff] ^ kTables[0][high >> 24];
+    }
+  }
+
+  for (; i < bytes.size(); i++)
+  {
+    c = kTables[0][(c ^ bytes[i]) & 0xff] ^ (c >> 8);
+  }
+
+  return c ^ 0xffffffffu;
+}
@@ -0,0 +1,11 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+
+namespace CppDuke
+{
+// CRC-32 as zip archives compute it, so checksums of class files match the
+// ones recorded for them in a JAR.
+uint32_t Crc32(std::span<const uint8_t> bytes);
+}
@@ -0,0 +1,119 @@
+#include "classfile.hpp"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <stdexcept>
+#include <utility>
+
+CppDuke::ClassFile::ClassFile(const uint8_t *data, const std::size_t size)
+    : _data(data),
+      _size(size),
+      _mapped(true)
+{
+}
+
+CppDuke::ClassFile::ClassFile(std::vector<uint8_t> bytes)
+    : _data(nullptr),
+      _size(bytes.size()),
+      _buffer(std::move(bytes)),
+      _mapped(false)
+{
+  _data = _buffer.data();
+}
+
+CppDuke::ClassFile::ClassFile(ClassFile &&other) noexcept
+    : _data(std::exchange(other._data, nullptr)),
+      _size(std::exchange(other._size, 0)),
+      _buffer(std::move(other._buffer)),
+      _mapped(std::exchange(other._mapped, false))
+{
+}
+
+CppDuke::ClassFile &CppDuke::ClassFile::operator=(ClassFile &&other) noexcept
+{
+  if (this != &other)
+  {
+    if (_mapped && _size)
+    {
+      munmap(const_cast<uint8_t *>(_data), _size);
+    }
+
+    _data = std::exchange(other._data, nullptr);
+    _size = std::exchange(other._size, 0);
+    _buffer = std::move(other._buffer);
+    _mapped = std::exchange(other._mapped, false);
+  }
+
+  return *this;
+}
+
+CppDuke::ClassFile::~ClassFile()
+{
+  if (_mapped && _size)
+  {
+    munmap(const_cast<uint8_t *>(_data), _size);
+  }
+}
+
+CppDuke::ClassFile CppDuke::ClassFile::Map(const std::string &path)
+{
+  const int kFd = open(path.c_str(), O_RDONLY);
+  struct stat st{};
+  if (kFd < 0 || fstat(kFd, &st) != 0)
+  {
+    if (kFd >= 0)
+    {
+      close(kFd);
+    }
+    throw std::invalid_argument("Cannot read class file: " + path);
+  }
+
+  // An empty file cannot be mapped, it still parses as a truncated class.
+  const std::size_t kSize = static_cast<std::size_t>(st.st_size);
+  void *data = kSize ? mmap(nullptr, kSize, PROT_READ, MAP_PRIVATE, kFd, 0) : nullptr;
+  close(kFd);
+  if (data == MAP_FAILED)
+  {
+    throw std::invalid_argument("Cannot map class file: " + path);
+  }
+
+  return ClassFile{static_cast<const uint8_t *>(data), kSize};
+}
+
+CppDuke::ClassFile CppDuke::ClassFile::Read(const std::string &path)
+{
+  const int kFd = open(path.c_str(), O_RDONLY);
+  struct stat st{};
+  if (kFd < 0 || fstat(kFd, &st) != 0)
+  {
+    if (kFd >= 0)
+    {
+      close(kFd);
+    }
+    throw std::invalid_argument("Cannot read class file: " + path);
+  }
+
+  std::vector<uint8_t> bytes(static_cast<std::size_t>(st.st_size));
+  std::size_t done = 0;
+  while (done < bytes.size())
+  {
+    const ssize_t kRead = read(kFd, bytes.data() + done, bytes.size() - done);
+    if (kRead <= 0)
+    {
+      close(kFd);
+      throw std::invalid_argument("Cannot read class file: " + path);
+    }
+    done += static_cast<std::size_t>(kRead);
+  }
+
+  close(kFd);
+  return ClassFile{std::move(bytes)};
+}
+
+std::span<const uint8_t> CppDuke::ClassFile::Bytes() const
+{
+  return {_data, _size};
+}
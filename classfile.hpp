@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+#include <string>
+#include <vector>
+
+namespace CppDuke
+{
+// The bytes of one class file, either mapped from disk or handed over from
+// memory, e.g. after being extracted from an archive. Parsed classes keep
+// views into them, so they live as long as the class does.
+class ClassFile
+{
+  const uint8_t *_data;
+  std::size_t _size;
+  // Set when the bytes came from memory, empty when they are mapped.
+  std::vector<uint8_t> _buffer;
+  bool _mapped;
+
+  ClassFile(const uint8_t *data, std::size_t size);
+
+public:
+  explicit ClassFile(std::vector<uint8_t> bytes);
+  ClassFile(ClassFile &&other) noexcept;
+  ClassFile &operator=(ClassFile &&other) noexcept;
+  ClassFile(const ClassFile &) = delete;
+  ClassFile &operator=(const ClassFile &) = delete;
+  ~ClassFile();
+
+  // Maps path read only. Throws std::invalid_argument if it cannot be read.
+  static ClassFile Map(const std::string &path);
+
+  // Copies path into memory. Cheaper than mapping a small file that is only
+  // read once from start to end. Throws std::invalid_argument if it cannot
+  // be read.
+  static ClassFile Read(const std::string &path);
+
+  std::span<const uint8_t> Bytes() const;
+};
+}
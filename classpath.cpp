@@ -0,0 +1,121 @@
+#include "classpath.hpp"
+
+#include <algorithm>
+#include <filesystem>
+#include <stdexcept>
+
+#include "checksum.hpp"
+
+namespace
+{
+constexpr std::string_view kSuffix = ".class";
+}
+
+CppDuke::ClassPath::ClassPath(std::string_view path)
+{
+  while (!path.empty())
+  {
+    const std::size_t kEnd = std::min(path.find(':'), path.size());
+    const std::string kEntry{path.substr(0, kEnd)};
+    path.remove_prefix(std::min(kEnd + 1, path.size()));
+
+    std::error_code error;
+    if (kEntry.empty() || !std::filesystem::exists(kEntry, error))
+    {
+      continue;
+    }
+
+    if (std::filesystem::is_directory(kEntry, error))
+    {
+      _AddDirectory(kEntry);
+    } else
+    {
+      _AddArchive(kEntry);
+    }
+  }
+}
+
+void CppDuke::ClassPath::_AddDirectory(const std::string &directory)
+{
+  std::error_code error;
+  for (auto itr = std::filesystem::recursive_directory_iterator{directory, error};
+       itr != std::filesystem::recursive_directory_iterator{};
+       itr.increment(error))
+  {
+    const std::string kFile = itr->path().lexically_relative(directory).generic_string();
+    if (itr->is_regular_file(error) && kFile.ends_with(kSuffix))
+    {
+      _index.emplace(kFile.substr(0, kFile.size() - kSuffix.size()),
+                     Location{nullptr, nullptr, itr->path().string()});
+    }
+  }
+}
+
+void CppDuke::ClassPath::_AddArchive(const std::string &path)
+{
+  const Archive &archive = *_archives.emplace_back(std::make_unique<Archive>(path));
+  for (const Archive::Entry &entry: archive.Entries())
+  {
+    if (entry.name.ends_with(kSuffix))
+    {
+      _index.emplace(entry.name.substr(0, entry.name.size() - kSuffix.size()),
+                     Location{&archive, &entry, path});
+    }
+  }
+}
+
+std::optional<CppDuke::ClassFile> CppDuke::ClassPath::Open(const std::string &name) const
+{
+  auto itr = _index.find(name);
+  if (itr == std::end(_index))
+  {
+    return std::nullopt;
+  }
+
+  const Location &kLocation = itr->second;
+  if (kLocation.archive == nullptr)
+  {
+    return ClassFile::Map(kLocation.path);
+  }
+
+  return ClassFile{kLocation.archive->Extract(*kLocation.entry)};
+}
+
+std::optional<uint32_t> CppDuke::ClassPath::Checksum(const std::string &name) const
+{
+  auto itr = _index.find(name);
+  if (itr == std::end(_index))
+  {
+    return std::nullopt;
+  }
+
+  const Location &kLocation = itr->second;
+  if (kLocation.archive == nullptr)
+  {
+    return Crc32(ClassFile::Read(kLocation.path).Bytes());
+  }
+
+  return kLocation.entry->crc;
+}
+
+bool CppDuke::ClassPath::Contains(const std::string &name) const
+{
+  return _index.contains(name);
+}
+
+std::size_t CppDuke::ClassPath::Size() const
+{
+  return _index.size();
+}
+
+std::vector<std::string> CppDuke::ClassPath::Names() const
+{
+  std::vector<std::string> names;
+  names.reserve(_index.size());
+  for (const auto &[name, location]: _index)
+  {
+    names.push_back(name);
+  }
+
+  return names;
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "archive.hpp"
+#include "classfile.hpp"
+
+namespace CppDuke
+{
+// Where classes are found, as given by -cp: directories and zip or JAR
+// archives. Every entry is listed once when the class path is made, reading a
+// class then goes straight to its location. Read only after construction,
+// safe to use from several threads.
+class ClassPath
+{
+  struct Location
+  {
+    // Null for a class file in a directory.
+    const Archive *archive;
+    const Archive::Entry *entry;
+    std::string path;
+  };
+
+  std::vector<std::unique_ptr<Archive>> _archives;
+  // By binary name, such as java/lang/Object.
+  std::unordered_map<std::string, Location> _index;
+
+  void _AddDirectory(const std::string &directory);
+  void _AddArchive(const std::string &path);
+
+public:
+  // Entries are separated by ':'. Earlier entries win when several hold the
+  // same class. Entries that do not exist are skipped, as the JVM does.
+  explicit ClassPath(std::string_view path);
+
+  // The class file of the class with binary name name, none if it is not on
+  // the class path. Throws if it is there but cannot be read.
+  std::optional<ClassFile> Open(const std::string &name) const;
+
+  // Whether Open() would find name, without reading it.
+  bool Contains(const std::string &name) const;
+
+  // CRC-32 of the class file Open() would return, none if it is not on the
+  // class path. Archives record it, class files in directories are read.
+  std::optional<uint32_t> Checksum(const std::string &name) const;
+
+  // Classes found on the path.
+  std::size_t Size() const;
+  // Their binary names, in no particular order.
+  std::vector<std::string> Names() const;
+};
+}
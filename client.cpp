@@ -0,0 +1,26 @@
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "server.hpp"
+
+// Runs a program on a server started with -Xserver:<socket>, as if jvmcpp
+// was run here with the same options and main class.
+int main(int argc, char **argv)
+{
+  if (argc < 3)
+  {
+    std::cerr << "Usage: " << argv[0] << " <socket> [options] <main class>\n";
+    return 1;
+  }
+
+  try
+  {
+    return CppDuke::Server::Request(argv[1], {argv + 2, argv + argc});
+  } catch (const std::invalid_argument &e)
+  {
+    std::cerr << "Error: " << e.what() << "\n";
+    return 1;
+  }
+}
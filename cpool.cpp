@@ -1,47 +1,56 @@
 #include "cpool.hpp"
 
-CppDuke::ConstantPool::PoolEntry::~PoolEntry()
-{};
+#include <stdexcept>
 
-CppDuke::ConstantPool::GenericEntry::GenericEntry(uint16_t v1,
-                                                  uint16_t v2)
-    : _v1(v1), // high bytes
-      _v2(v2)  // low bytes
-{}
+namespace
+{
+// Offsets in the body of a Code attribute.
+constexpr std::size_t kMaxStack = 0, kMaxLocals = 2, kCodeLength = 4, kCode = 8;
+
+uint32_t U2(const std::span<const uint8_t> bytes, const std::size_t pos)
+{
+  return (bytes[pos] << 8) | bytes[pos + 1];
+}
 
-uint16_t CppDuke::ConstantPool::GenericEntry::Low() const
+uint32_t U4(const std::span<const uint8_t> bytes, const std::size_t pos)
 {
-  return _v1;
+  return (U2(bytes, pos) << 16) | U2(bytes, pos + 2);
+}
 }
 
-uint16_t CppDuke::ConstantPool::GenericEntry::High() const
+CppDuke::ConstantPool::CodeAttribute::CodeAttribute(const std::span<const uint8_t> body)
+    : _body(body)
 {
-  return _v2;
+  if (body.size() < kCode || U4(body, kCodeLength) > body.size() - kCode)
+  {
+    throw std::invalid_argument("Truncated Code attribute");
+  }
 }
 
-CppDuke::ConstantPool::CodeAttribute::CodeAttribute(uint16_t stack,
-                                                    uint16_t locals,
-                                                    std::vector<uint8_t> code)
-    : _stack(stack),   // Max stack length
-      _locals(locals), // Max locals
-      _code(code)      // Byte code
+std::span<const uint8_t> CppDuke::ConstantPool::CodeAttribute::Body() const
 {
+  return _body;
 }
 
-std::vector<uint8_t> CppDuke::ConstantPool::CodeAttribute::ByteCode() const
+std::span<const uint8_t> CppDuke::ConstantPool::CodeAttribute::ByteCode() const
 {
-  return _code;
+  return _body.subspan(kCode, U4(_body, kCodeLength));
 }
 
 uint16_t CppDuke::ConstantPool::CodeAttribute::BufferSize() const
 {
-  return _locals;
+  return U2(_body, kMaxLocals);
+}
+
+uint16_t CppDuke::ConstantPool::CodeAttribute::MaxStack() const
+{
+  return U2(_body, kMaxStack);
 }
 
 CppDuke::ConstantPool::CommonAttribute::CommonAttribute(uint16_t nameIndex,
                                                         uint32_t length,
-                                                        std::string name,
-                                                        std::shared_ptr<CodeAttribute> opt)
+                                                        Symbol name,
+                                                        const CodeAttribute *opt)
     : _nameIndex(nameIndex), // Name index
       _length(length),       // Length of the attribute
       _name(name),           // Name of the attribute
@@ -49,32 +58,38 @@ CppDuke::ConstantPool::CommonAttribute::CommonAttribute(uint16_t nameIndex,
 {
 }
 
-std::shared_ptr<CppDuke::ConstantPool::CodeAttribute>
-CppDuke::ConstantPool::CommonAttribute::GetCodeAttribute() const
+const CppDuke::ConstantPool::CodeAttribute *CppDuke::ConstantPool::CommonAttribute::GetCodeAttribute() const
 {
   return _opt;
 }
 
-std::string CppDuke::ConstantPool::CommonAttribute::Name() const
+CppDuke::Symbol CppDuke::ConstantPool::CommonAttribute::Name() const
 {
   return _name;
 }
 
+uint16_t CppDuke::ConstantPool::CommonAttribute::NameIndex() const
+{
+  return _nameIndex;
+}
+
+uint32_t CppDuke::ConstantPool::CommonAttribute::Length() const
+{
+  return _length;
+}
+
 CppDuke::ConstantPool::CommonRef::CommonRef(uint16_t fAccess,
                                             uint16_t nameIndex,
                                             uint16_t descIndex,
-                                            uint16_t attributeLength,
-                                            std::vector<CommonAttribute> chAttributes)
+                                            std::span<const CommonAttribute> chAttributes)
     : _fAccess(fAccess),
       _nameIndex(nameIndex),
       _descIndex(descIndex),
-      _attributeLength(attributeLength),
       _chAttributes(chAttributes) // Child attributes
 {
 }
 
-std::vector<CppDuke::ConstantPool::CommonAttribute>
-CppDuke::ConstantPool::CommonRef::GetChildAttributes() const
+std::span<const CppDuke::ConstantPool::CommonAttribute> CppDuke::ConstantPool::CommonRef::GetChildAttributes() const
 {
   return _chAttributes;
 }
@@ -94,21 +109,80 @@ uint16_t CppDuke::ConstantPool::CommonRef::NameIndex() const
   return _nameIndex;
 }
 
-CppDuke::ConstantPool::Utf8::Utf8(const std::string &s) :
-    _S(s) // Holds the string value.
-{}
+CppDuke::ConstantPool::Pool::Pool(const std::span<const Entry> entries)
+    : _entries(entries)
+{
+}
+
+const CppDuke::ConstantPool::Pool::Entry &
+CppDuke::ConstantPool::Pool::_At(const uint16_t idx, const EntryType tag) const
+{
+  if (idx >= _entries.size() || _entries[idx].tag != tag)
+  {
+    throw std::invalid_argument("Bad constant pool reference: " + std::to_string(idx));
+  }
+
+  return _entries[idx];
+}
 
-std::string CppDuke::ConstantPool::Utf8::Data() const
+std::size_t CppDuke::ConstantPool::Pool::Size() const
 {
-  return _S;
+  return _entries.size();
 }
 
-CppDuke::ConstantPool::KlassInfo::KlassInfo(uint16_t v)
+std::span<const CppDuke::ConstantPool::Pool::Entry> CppDuke::ConstantPool::Pool::Entries() const
 {
-  _nameIndex = v;
+  return _entries;
 }
 
-uint16_t CppDuke::ConstantPool::KlassInfo::NameIndex() const
+CppDuke::ConstantPool::EntryType CppDuke::ConstantPool::Pool::Tag(const uint16_t idx) const
 {
-  return _nameIndex;
+  return idx < _entries.size() ? _entries[idx].tag : EMPTY;
+}
+
+CppDuke::Symbol CppDuke::ConstantPool::Pool::Utf8(const uint16_t idx) const
+{
+  return _At(idx, UTF_8).utf8;
+}
+
+int32_t CppDuke::ConstantPool::Pool::Integer(const uint16_t idx) const
+{
+  return _At(idx, INTEGER).i;
+}
+
+float CppDuke::ConstantPool::Pool::Float(const uint16_t idx) const
+{
+  return _At(idx, FLOAT).f;
+}
+
+int64_t CppDuke::ConstantPool::Pool::Long(const uint16_t idx) const
+{
+  return _At(idx, LONG).l;
+}
+
+double CppDuke::ConstantPool::Pool::Double(const uint16_t idx) const
+{
+  return _At(idx, CONST_DOUBLE).d;
+}
+
+CppDuke::Symbol CppDuke::ConstantPool::Pool::KlassName(const uint16_t idx) const
+{
+  return Utf8(_At(idx, CLASS).ref.first);
+}
+
+CppDuke::Symbol CppDuke::ConstantPool::Pool::String(const uint16_t idx) const
+{
+  return Utf8(_At(idx, STRING).ref.first);
+}
+
+CppDuke::ConstantPool::MemberRef CppDuke::ConstantPool::Pool::Member(const uint16_t idx) const
+{
+  if (idx >= _entries.size()
+      || (_entries[idx].tag != FIELD_REF && _entries[idx].tag != METHOD_REF && _entries[idx].tag != INTERFACE_REF))
+  {
+    throw std::invalid_argument("Bad member reference: " + std::to_string(idx));
+  }
+
+  const Entry &kNameType = _At(_entries[idx].ref.second, NAME_TYPE_REF);
+  return MemberRef{KlassName(_entries[idx].ref.first), Utf8(kNameType.ref.first), Utf8(kNameType.ref.second)};
 }
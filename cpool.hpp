@@ -1,15 +1,22 @@
 #pragma once
 
-#include <vector>
+#include <cstdint>
+#include <span>
 #include <string>
-#include <memory>
+
+#include "symbol.hpp"
 
 namespace CppDuke::ConstantPool
 {
 // These values are taken from Oracle's spec sheet.
-typedef enum
+typedef enum : uint8_t
 {
+  // The unusable slot after a long or double, and slot zero.
+  EMPTY = 0,
   UTF_8 = 1,
+  INTEGER = 3,
+  FLOAT = 4,
+  LONG = 5,
   CONST_DOUBLE = 6,
   CLASS = 7,
   STRING = 8,
@@ -17,85 +24,126 @@ typedef enum
   METHOD_REF = 10,
   INTERFACE_REF = 11,
   NAME_TYPE_REF = 12,
+  METHOD_HANDLE = 15,
+  METHOD_TYPE = 16,
+  DYNAMIC = 17,
+  INVOKE_DYNAMIC = 18,
+  MODULE = 19,
+  PACKAGE = 20,
 } EntryType;
 
-class PoolEntry
+// A resolved Fieldref, Methodref or InterfaceMethodref.
+struct MemberRef
+{
+  Symbol klass, name, descriptor;
+};
+
+// The constant pool as one array of fixed size entries, indexed the way the
+// class file does it, from 1. Numbers are stored decoded and text as
+// interned symbols, so no access allocates or casts.
+class Pool
 {
 public:
-  virtual ~PoolEntry();
+  struct Entry
+  {
+    union
+    {
+      int32_t i;
+      float f;
+      int64_t l;
+      double d;
+      Symbol utf8;
+      // Indices of the entries a reference is made of, e.g. the class and
+      // name and type of a Methodref. A MethodHandle keeps its kind in
+      // first.
+      struct
+      {
+        uint16_t first, second;
+      } ref;
+    };
+    EntryType tag;
+  };
+
+private:
+  // Lives in the arena of the class, as the rest of its metadata.
+  std::span<const Entry> _entries;
+
+  const Entry &_At(uint16_t idx, EntryType tag) const;
+
+public:
+  Pool() = default;
+  explicit Pool(std::span<const Entry> entries);
+
+  // Entries, including the unused slot zero.
+  std::size_t Size() const;
+  std::span<const Entry> Entries() const;
+  EntryType Tag(uint16_t idx) const;
+
+  // Each one throws if idx does not hold an entry of the matching kind.
+  Symbol Utf8(uint16_t idx) const;
+  int32_t Integer(uint16_t idx) const;
+  float Float(uint16_t idx) const;
+  int64_t Long(uint16_t idx) const;
+  double Double(uint16_t idx) const;
+  Symbol KlassName(uint16_t idx) const;
+  Symbol String(uint16_t idx) const;
+  MemberRef Member(uint16_t idx) const;
 };
 
-class CodeAttribute : PoolEntry
+// Attributes and members below are built by the parser inside the arena of
+// the class they belong to, so they hold plain pointers and spans into it and
+// are never destroyed on their own.
+// Only the bounds of a Code attribute are recorded when the class is parsed,
+// its fields are read from the file when the method is first decoded.
+class CodeAttribute
 {
 private:
-  uint16_t _stack, _locals;
-  std::vector<uint8_t> _code;
+  // The attribute past its name and length, starting at max_stack.
+  std::span<const uint8_t> _body;
 
 public:
-  explicit CodeAttribute(uint16_t stack, uint16_t locals, std::vector<uint8_t> code);
-  std::vector<uint8_t> ByteCode() const;
+  // Throws if body is too short for the bytecode it claims to hold.
+  explicit CodeAttribute(std::span<const uint8_t> body);
+  std::span<const uint8_t> Body() const;
+  std::span<const uint8_t> ByteCode() const;
   uint16_t BufferSize() const;
+  uint16_t MaxStack() const;
 };
 
-class CommonAttribute : PoolEntry
+class CommonAttribute
 {
 private:
   uint16_t _nameIndex;
   uint32_t _length;
 
-  std::string _name;
-  std::shared_ptr<CodeAttribute> _opt;
+  Symbol _name;
+  const CodeAttribute *_opt;
 public:
   explicit CommonAttribute(uint16_t nameIndex,
                            uint32_t length,
-                           std::string name,
-                           std::shared_ptr<CodeAttribute> code);
-  std::shared_ptr<CodeAttribute> GetCodeAttribute() const;
-  std::string Name() const;
+                           Symbol name,
+                           const CodeAttribute *code);
+  // Null unless this is a Code attribute.
+  const CodeAttribute *GetCodeAttribute() const;
+  Symbol Name() const;
+  uint16_t NameIndex() const;
+  uint32_t Length() const;
 };
 
-class CommonRef : PoolEntry
+class CommonRef
 {
 private:
-  uint16_t _fAccess, _nameIndex, _descIndex, _attributeLength;
-  std::vector<CommonAttribute> _chAttributes;
+  uint16_t _fAccess, _nameIndex, _descIndex;
+  std::span<const CommonAttribute> _chAttributes;
 public:
   explicit CommonRef(uint16_t fAccess,
                      uint16_t nameIndex,
                      uint16_t descIndex,
-                     uint16_t attributeLength,
-                     std::vector<CommonAttribute> chAttributes);
-  std::vector<CommonAttribute> GetChildAttributes() const;
+                     std::span<const CommonAttribute> chAttributes);
+  std::span<const CommonAttribute> GetChildAttributes() const;
   uint16_t Flags() const;
   uint16_t DescIndex() const;
   uint16_t NameIndex() const;
 };
 
-class GenericEntry : public PoolEntry
-{
-private:
-  uint16_t _v1, _v2;
-public:
-  explicit GenericEntry(uint16_t v1, uint16_t v2);
-  uint16_t Low() const;
-  uint16_t High() const;
-};
-
-class Utf8 : public PoolEntry
-{
-private:
-  std::string _S;
-public:
-  explicit Utf8(const std::string &s);
-
-  std::string Data() const;
-};
-
-class KlassInfo : public PoolEntry
-{
-  uint16_t _nameIndex;
-public:
-  explicit KlassInfo(uint16_t v);
-  uint16_t NameIndex() const;
-};
 } // CppDuke::ConstantPool
@@ -0,0 +1,444 @@
+#include "decoder.hpp"
+#include "vm.hpp"
+
+#include <stdexcept>
+
+using namespace CppDuke::VirtualMachine;
+
+namespace
+{
+uint8_t U1(const std::span<const uint8_t> code, const uint32_t pos)
+{
+  return code[pos];
+}
+
+uint16_t U2(const std::span<const uint8_t> code, const uint32_t pos)
+{
+  return (code[pos] << 8) | code[pos + 1];
+}
+
+int32_t S4(const std::span<const uint8_t> code, const uint32_t pos)
+{
+  return static_cast<int32_t>((code[pos] << 24) | (code[pos + 1] << 16) | (code[pos + 2] << 8) | code[pos + 3]);
+}
+
+// Throws unless code holds every byte before end, which the instruction at
+// bci needs.
+void Require(const std::span<const uint8_t> code, const uint32_t bci, const uint64_t end)
+{
+  if (end > code.size())
+  {
+    throw std::invalid_argument("Truncated instruction at " + std::to_string(bci));
+  }
+}
+
+// Size of the instruction at bci, including its operands. Operands it takes
+// the size from are checked to be there before they are read.
+uint32_t Length(const std::span<const uint8_t> code, const uint32_t bci)
+{
+  const uint8_t kOpcode = code[bci];
+  switch (kOpcode)
+  {
+    case 0x10: // bipush
+    case 0x12: // ldc
+    case 0x15 ... 0x19: // loads
+    case 0x36 ... 0x3a: // stores
+    case 0xa9: // ret
+    case 0xbc: // newarray
+      return 2;
+
+    case 0x11: // sipush
+    case 0x13: // ldc_w
+    case 0x14: // ldc2_w
+    case 0x84: // iinc
+    case 0x99 ... 0xa8: // branches, goto and jsr
+    case 0xb2 ... 0xb8: // field access and invokes
+    case 0xbb: // new
+    case 0xbd: // anewarray
+    case 0xc0: // checkcast
+    case 0xc1: // instanceof
+    case 0xc6: // ifnull
+    case 0xc7: // ifnonnull
+      return 3;
+
+    case 0xc5: // multianewarray
+      return 4;
+
+    case 0xb9: // invokeinterface
+    case 0xba: // invokedynamic
+    case 0xc8: // goto_w
+    case 0xc9: // jsr_w
+      return 5;
+
+    case 0xc4: // wide
+      Require(code, bci, bci + 2);
+      return code[bci + 1] == 0x84 ? 6 : 4;
+
+    case 0xaa: // tableswitch
+    {
+      const uint32_t kOperands = (bci + 4) & ~3u;
+      Require(code, bci, kOperands + 12);
+      const int32_t kLow = S4(code, kOperands + 4), kHigh = S4(code, kOperands + 8);
+      if (kHigh < kLow)
+      {
+        throw std::invalid_argument("Invalid instruction at " + std::to_string(bci));
+      }
+
+      const uint64_t kLength = kOperands - bci + 12 + 4 * (static_cast<uint64_t>(int64_t{kHigh} - kLow) + 1);
+      Require(code, bci, bci + kLength);
+      return static_cast<uint32_t>(kLength);
+    }
+
+    case 0xab: // lookupswitch
+    {
+      const uint32_t kOperands = (bci + 4) & ~3u;
+      Require(code, bci, kOperands + 8);
+      const int32_t kPairs = S4(code, kOperands + 4);
+      if (kPairs < 0)
+      {
+        throw std::invalid_argument("Invalid instruction at " + std::to_string(bci));
+      }
+
+      const uint64_t kLength = kOperands - bci + 8 + 8 * static_cast<uint64_t>(kPairs);
+      Require(code, bci, bci + kLength);
+      return static_cast<uint32_t>(kLength);
+    }
+
+    default:
+      return 1;
+  }
+}
+
+// Folds instruction variants onto a single opcode per handler and pulls the
+// operands out. Returns true if a holds a byte offset that still needs to
+// be turned into an instruction index.
+bool Decode(const std::span<const uint8_t> code, Instruction &ins)
+{
+  const uint32_t kBci = ins.bci;
+  switch (ins.opcode)
+  {
+    case ICONST_M1:
+    case ICONST_0:
+    case ICONST_1:
+    case ICONST_2:
+    case ICONST_3:
+    case ICONST_4:
+    case ICONST_5:
+      ins.a = ins.opcode - ICONST_0;
+      ins.opcode = SIPUSH;
+      break;
+
+    case BIPUSH:
+      ins.a = static_cast<int8_t>(U1(code, kBci + 1));
+      ins.opcode = SIPUSH;
+      break;
+
+    case SIPUSH:
+      ins.a = static_cast<int16_t>(U2(code, kBci + 1));
+      break;
+
+    case LCONST_0:
+    case LCONST_1:
+      ins.a = ins.opcode - LCONST_0;
+      ins.opcode = LCONST_0;
+      break;
+
+    case FCONST_0:
+    case FCONST_1:
+    case FCONST_2:
+      ins.a = ins.opcode - FCONST_0;
+      ins.opcode = FCONST_0;
+      break;
+
+    case DCONST_0:
+    case DCONST_1:
+      ins.a = ins.opcode - DCONST_0;
+      ins.opcode = DCONST_0;
+      break;
+
+    case LDC:
+    case NEWARRAY:
+      ins.a = U1(code, kBci + 1);
+      break;
+
+    case LDC_W:
+    case LDC2_W:
+      ins.a = U2(code, kBci + 1);
+      ins.opcode = LDC;
+      break;
+
+    // Slots are untyped, every load and store is the same copy.
+    case ILOAD:
+    case LLOAD:
+    case FLOAD:
+    case DLOAD:
+    case ALOAD:
+      ins.a = U1(code, kBci + 1);
+      ins.opcode = ILOAD;
+      break;
+
+    case ILOAD_0 ... ALOAD_3:
+      ins.a = (ins.opcode - ILOAD_0) % 4;
+      ins.opcode = ILOAD;
+      break;
+
+    case ISTORE:
+    case LSTORE:
+    case FSTORE:
+    case DSTORE:
+    case ASTORE:
+      ins.a = U1(code, kBci + 1);
+      ins.opcode = ISTORE;
+      break;
+
+    case ISTORE_0 ... ASTORE_3:
+      ins.a = (ins.opcode - ISTORE_0) % 4;
+      ins.opcode = ISTORE;
+      break;
+
+    case IALOAD ... SALOAD:
+      ins.opcode = IALOAD;
+      break;
+
+    case IASTORE ... SASTORE:
+      ins.opcode = IASTORE;
+      break;
+
+    case IINC:
+      ins.a = U1(code, kBci + 1);
+      ins.b = static_cast<int8_t>(U1(code, kBci + 2));
+      break;
+
+    case IFEQ ... IF_ICMPLE:
+    case GOTO:
+    case IFNULL:
+    case IFNONNULL:
+      // Offset used here is relative and not absolute.
+      ins.a = static_cast<int32_t>(kBci) + static_cast<int16_t>(U2(code, kBci + 1));
+      return true;
+
+    case GOTO_W:
+      ins.a = static_cast<int32_t>(kBci) + S4(code, kBci + 1);
+      ins.opcode = GOTO;
+      return true;
+
+    case IRETURN ... ARETURN:
+      ins.opcode = IRETURN;
+      break;
+
+    case GETSTATIC ... INVOKESTATIC:
+    case NEW:
+      ins.a = U2(code, kBci + 1);
+      break;
+
+    default:
+      break;
+  }
+
+  return false;
+}
+
+int32_t Pack(const int32_t lo, const int32_t hi)
+{
+  return static_cast<int32_t>((static_cast<uint32_t>(hi) << 16) | (static_cast<uint32_t>(lo) & 0xffff));
+}
+
+// Rewrites the first instruction of a known sequence into a superinstruction
+// that does the work of the whole sequence, straight on the locals. The
+// rest of the sequence is left in place and skipped over, so instruction
+// indices and branch targets stay valid. Sequences with a branch target
+// past their first instruction are left alone.
+void Fuse(std::vector<Instruction> &code, const std::vector<bool> &targets)
+{
+  auto matches = [&](const std::size_t i, std::initializer_list<uint8_t> pattern) -> bool
+  {
+    if (i + pattern.size() > code.size())
+    {
+      return false;
+    }
+
+    std::size_t j = i;
+    for (uint8_t opcode: pattern)
+    {
+      if (code[j].opcode != opcode || (j != i && targets[j]))
+      {
+        return false;
+      }
+      j++;
+    }
+
+    return true;
+  };
+
+  for (std::size_t i = 0; i < code.size(); i++)
+  {
+    Instruction &ins = code[i];
+
+    // iload_x; iload_y; if_icmp<cond>
+    if (i + 2 < code.size()
+        && code[i + 2].opcode >= IF_ICMPEQ && code[i + 2].opcode <= IF_ICMPLE
+        && matches(i, {ILOAD, ILOAD, code[i + 2].opcode}))
+    {
+      ins.opcode = ILOAD_ILOAD_IF_ICMPEQ + (code[i + 2].opcode - IF_ICMPEQ);
+      ins.b = Pack(ins.a, code[i + 1].a);
+      ins.a = code[i + 2].a;
+      i += 2;
+    }
+    // iload; iconst; iadd; istore
+    else if (matches(i, {ILOAD, SIPUSH, IADD, ISTORE}))
+    {
+      ins.opcode = ILOAD_ICONST_IADD_ISTORE;
+      ins.b = Pack(ins.a, code[i + 3].a);
+      ins.a = code[i + 1].a;
+      i += 3;
+    }
+    // aload; iload; <t>aload
+    else if (matches(i, {ILOAD, ILOAD, IALOAD}))
+    {
+      ins.opcode = ILOAD_ILOAD_IALOAD;
+      ins.b = Pack(ins.a, code[i + 1].a);
+      i += 2;
+    }
+    // iinc; goto
+    else if (matches(i, {IINC, GOTO}))
+    {
+      ins.opcode = IINC_GOTO;
+      ins.b = Pack(ins.a, ins.b);
+      ins.a = code[i + 1].a;
+      i += 1;
+    }
+  }
+}
+}
+
+DecodedMethod::DecodedMethod(const Klass &klass,
+                             const MethodSignature &signature,
+                             const ConstantPool::CodeAttribute &code,
+                             const bool fuse)
+    : _klass(&klass),
+      _signature(&signature),
+      _code(&code),
+      _maxLocals(code.BufferSize()),
+      _maxStack(code.MaxStack()),
+      _handlers(nullptr),
+      _synchronized(false),
+      _monitor(nullptr)
+{
+  const std::span<const uint8_t> kByteCode = code.ByteCode();
+
+  // Maps a byte offset to the instruction starting there, -1 for offsets
+  // that fall inside an instruction.
+  std::vector<int32_t> index(kByteCode.size() + 1, -1);
+  std::vector<std::size_t> branches;
+
+  for (uint32_t bci = 0; bci < kByteCode.size();)
+  {
+    const uint32_t kLength = Length(kByteCode, bci);
+    Require(kByteCode, bci, uint64_t{bci} + kLength);
+
+    index[bci] = static_cast<int32_t>(_instructions.size());
+    Instruction ins{nullptr, 0, 0, {nullptr}, bci, kByteCode[bci]};
+    if (Decode(kByteCode, ins))
+    {
+      branches.push_back(_instructions.size());
+    }
+
+    _instructions.push_back(ins);
+    bci += kLength;
+  }
+
+  std::vector<bool> targets(_instructions.size());
+  for (std::size_t i: branches)
+  {
+    Instruction &ins = _instructions[i];
+    if (ins.a < 0 || ins.a >= static_cast<int32_t>(kByteCode.size()) || index[ins.a] < 0)
+    {
+      throw std::invalid_argument("Invalid branch target at " + std::to_string(ins.bci));
+    }
+
+    ins.a = index[ins.a];
+    targets[ins.a] = true;
+  }
+
+  if (fuse)
+  {
+    Fuse(_instructions, targets);
+  }
+}
+
+const CppDuke::Klass &DecodedMethod::Owner() const
+{
+  return *_klass;
+}
+
+const CppDuke::MethodSignature &DecodedMethod::Signature() const
+{
+  return *_signature;
+}
+
+const CppDuke::ConstantPool::CodeAttribute &DecodedMethod::Code() const
+{
+  return *_code;
+}
+
+const Instruction *DecodedMethod::Entry() const
+{
+  return _instructions.data();
+}
+
+std::size_t DecodedMethod::Size() const
+{
+  return _instructions.size();
+}
+
+uint16_t DecodedMethod::MaxLocals() const
+{
+  return _maxLocals;
+}
+
+uint16_t DecodedMethod::MaxStack() const
+{
+  return _maxStack;
+}
+
+void DecodedMethod::Thread(const void *const *handlers)
+{
+  for (Instruction &ins: _instructions)
+  {
+    ins.handler = handlers[ins.opcode];
+  }
+
+  _handlers = handlers;
+}
+
+void DecodedMethod::Synchronize(Object *monitor)
+{
+  for (Instruction &ins: _instructions)
+  {
+    if (ins.opcode == IRETURN)
+    {
+      ins.opcode = IRETURN_SYNCHRONIZED;
+    } else if (ins.opcode == RETURN)
+    {
+      ins.opcode = RETURN_SYNCHRONIZED;
+    }
+  }
+
+  _synchronized = true;
+  _monitor = monitor;
+}
+
+bool DecodedMethod::Synchronized() const
+{
+  return _synchronized;
+}
+
+Object *DecodedMethod::Monitor() const
+{
+  return _monitor;
+}
+
+bool DecodedMethod::ThreadedWith(const void *const *handlers) const
+{
+  return _handlers == handlers;
+}
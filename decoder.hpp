@@ -0,0 +1,72 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "cpool.hpp"
+#include "klass.hpp"
+#include "value.hpp"
+
+namespace CppDuke::VirtualMachine
+{
+// A pre-decoded instruction. Operands are extracted once when the method is
+// decoded and branch targets are instruction indices, not byte offsets.
+class DecodedMethod;
+struct Layout;
+
+struct Instruction
+{
+  // Address of the interpreter's handler, set when the method is threaded.
+  const void *handler;
+  int32_t a, b;
+  // What a quickened instruction works on, resolved on its first execution.
+  union
+  {
+    const Layout *layout;
+    Value *slot;
+    DecodedMethod *method;
+  } quick;
+  // Offset of the original instruction in the bytecode.
+  uint32_t bci;
+  uint8_t opcode;
+};
+
+class DecodedMethod
+{
+  const Klass *_klass;
+  const MethodSignature *_signature;
+  const ConstantPool::CodeAttribute *_code;
+  uint16_t _maxLocals, _maxStack;
+  std::vector<Instruction> _instructions;
+  const void *const *_handlers;
+  bool _synchronized;
+  Object *_monitor;
+
+public:
+  // Common sequences are fused into superinstructions unless told otherwise.
+  explicit DecodedMethod(const Klass &klass,
+                         const MethodSignature &signature,
+                         const ConstantPool::CodeAttribute &code,
+                         bool fuse = true);
+
+  const Klass &Owner() const;
+  const MethodSignature &Signature() const;
+  const ConstantPool::CodeAttribute &Code() const;
+  const Instruction *Entry() const;
+  std::size_t Size() const;
+  uint16_t MaxLocals() const;
+  uint16_t MaxStack() const;
+
+  // Makes every call hold a monitor until it returns: the one of monitor,
+  // or of the receiver if that is null. Must be done before threading.
+  void Synchronize(Object *monitor);
+  bool Synchronized() const;
+  // Null for instance methods.
+  Object *Monitor() const;
+
+  // Points every instruction at its handler in the given table. The table
+  // is indexed by opcode.
+  void Thread(const void *const *handlers);
+  bool ThreadedWith(const void *const *handlers) const;
+};
+}
@@ -0,0 +1,77 @@
+#include "index.hpp"
+
+std::size_t CppDuke::MemberIndex::_Hash(const Symbol name, const Symbol descriptor)
+{
+  // Symbols are unique, their addresses are as good as their contents.
+  const uint64_t kKey = reinterpret_cast<uintptr_t>(name) * 0x9e3779b97f4a7c15ull
+                        ^ reinterpret_cast<uintptr_t>(descriptor);
+  return static_cast<std::size_t>((kKey * 0xff51afd7ed558ccdull) >> 32);
+}
+
+void CppDuke::MemberIndex::Reserve(const std::size_t count)
+{
+  _keys.reserve(count);
+}
+
+void CppDuke::MemberIndex::Add(const Symbol name, const Symbol descriptor)
+{
+  _keys.push_back(Key{name, descriptor});
+}
+
+void CppDuke::MemberIndex::Build()
+{
+  // A power of two at least twice the member count keeps probe sequences
+  // short and lets the hash be masked instead of divided.
+  std::size_t capacity = 4;
+  while (capacity < _keys.size() * 2)
+  {
+    capacity <<= 1;
+  }
+
+  _slots.assign(capacity, 0);
+  for (std::size_t i = 0; i < _keys.size(); i++)
+  {
+    if (Find(_keys[i].name, _keys[i].descriptor) != kNotFound)
+    {
+      continue;
+    }
+
+    std::size_t slot = _Hash(_keys[i].name, _keys[i].descriptor) & (capacity - 1);
+    while (_slots[slot])
+    {
+      slot = (slot + 1) & (capacity - 1);
+    }
+
+    _slots[slot] = static_cast<uint32_t>(i + 1);
+  }
+}
+
+std::size_t CppDuke::MemberIndex::Find(const Symbol name, const Symbol descriptor) const
+{
+  if (_slots.empty())
+  {
+    return kNotFound;
+  }
+
+  const std::size_t kMask = _slots.size() - 1;
+  for (std::size_t slot = _Hash(name, descriptor) & kMask; _slots[slot]; slot = (slot + 1) & kMask)
+  {
+    const std::size_t kPos = _slots[slot] - 1;
+    if (_keys[kPos].name == name && _keys[kPos].descriptor == descriptor)
+    {
+      return kPos;
+    }
+  }
+
+  return kNotFound;
+}
+
+std::size_t CppDuke::MemberIndex::Size() const
+{
+  return _keys.size();
+}
+
+std::size_t CppDuke::MemberIndex::Bytes() const
+{
+  return _keys.capacity() * sizeof(Key) + _slots.capacity() * sizeof(uint32_t);
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "symbol.hpp"
+
+namespace CppDuke
+{
+// Finds a class member by name and descriptor. Built once when the class is
+// loaded, lookups probe a flat open-addressing table and never allocate.
+// Keys are symbols, so they are compared by address only.
+class MemberIndex
+{
+  struct Key
+  {
+    Symbol name, descriptor;
+  };
+
+  std::vector<Key> _keys;
+  // Each slot holds a position in _keys plus one, zero marks an empty slot.
+  std::vector<uint32_t> _slots;
+
+  static std::size_t _Hash(Symbol name, Symbol descriptor);
+
+public:
+  static constexpr std::size_t kNotFound = static_cast<std::size_t>(-1);
+
+  // Makes room for count members, so adding them does not reallocate.
+  void Reserve(std::size_t count);
+
+  // Adds the member at the next position, positions follow insertion order.
+  // Duplicate keys keep the first position.
+  void Add(Symbol name, Symbol descriptor);
+
+  // Sizes the table and fills it. Must be called once all members were added.
+  void Build();
+
+  std::size_t Find(Symbol name, Symbol descriptor) const;
+  std::size_t Size() const;
+  // Heap bytes held by the table.
+  std::size_t Bytes() const;
+};
+}
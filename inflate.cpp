@@ -0,0 +1,329 @@
+#include "inflate.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace
+{
+constexpr int kMaxBits = 15;
+constexpr int kMaxLengthCodes = 286;
+constexpr int kMaxDistanceCodes = 30;
+constexpr int kFixedLengthCodes = 288;
+
+// Base and extra bits of length codes 257 to 285 and of distance codes.
+constexpr uint16_t kLengthBase[] = {3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+                                    35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+constexpr uint8_t kLengthExtra[] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+                                    3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+constexpr uint16_t kDistanceBase[] = {1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129,
+                                      193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097,
+                                      6145, 8193, 12289, 16385, 24577};
+constexpr uint8_t kDistanceExtra[] = {0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6,
+                                      6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+
+// Order in which a dynamic block sends the code lengths of its code length code.
+constexpr uint8_t kCodeLengthOrder[] = {16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15};
+
+// A canonical Huffman code: how many codes have each length, and the symbols
+// ordered by code.
+struct Huffman
+{
+  uint16_t counts[kMaxBits + 1];
+  uint16_t symbols[kFixedLengthCodes];
+
+  Huffman(const uint8_t *lengths, const int n)
+  {
+    std::fill(std::begin(counts), std::end(counts), 0);
+    for (int i = 0; i < n; i++)
+    {
+      counts[lengths[i]]++;
+    }
+
+    // Incomplete codes are allowed, a single distance code is one, but an
+    // over-subscribed code cannot be decoded.
+    int left = 1;
+    for (int len = 1; len <= kMaxBits; len++)
+    {
+      left = (left << 1) - counts[len];
+      if (left < 0)
+      {
+        throw std::invalid_argument("Over-subscribed Huffman code");
+      }
+    }
+
+    uint16_t offsets[kMaxBits + 1];
+    offsets[1] = 0;
+    for (int len = 1; len < kMaxBits; len++)
+    {
+      offsets[len + 1] = offsets[len] + counts[len];
+    }
+
+    for (int i = 0; i < n; i++)
+    {
+      if (lengths[i])
+      {
+        symbols[offsets[lengths[i]]++] = i;
+      }
+    }
+  }
+};
+
+class Inflater
+{
+  std::span<const uint8_t> _data;
+  std::size_t _pos;
+  uint32_t _bits;
+  int _count;
+  std::vector<uint8_t> &_out;
+  // Output never grows past it, however much the data claims to hold.
+  std::size_t _limit;
+
+  // Called before n more bytes are written out.
+  void _Reserve(const std::size_t n)
+  {
+    if (n > _limit - _out.size())
+    {
+      throw std::invalid_argument("Inflated size does not match");
+    }
+  }
+
+  // Next n bits, least significant first.
+  uint32_t _Bits(const int n)
+  {
+    uint32_t bits = _bits;
+    while (_count < n)
+    {
+      if (_pos >= _data.size())
+      {
+        throw std::invalid_argument("Truncated deflate stream");
+      }
+      bits |= static_cast<uint32_t>(_data[_pos++]) << _count;
+      _count += 8;
+    }
+
+    _bits = bits >> n;
+    _count -= n;
+    return bits & ((1u << n) - 1);
+  }
+
+  // Codes are sent most significant bit first, so they are read a bit at a
+  // time. Within a length canonical codes are consecutive.
+  int _Decode(const Huffman &code)
+  {
+    int value = 0, first = 0, index = 0;
+    for (int len = 1; len <= kMaxBits; len++)
+    {
+      value |= static_cast<int>(_Bits(1));
+      const int kCount = code.counts[len];
+      if (value - first < kCount)
+      {
+        return code.symbols[index + value - first];
+      }
+
+      index += kCount;
+      first = (first + kCount) << 1;
+      value <<= 1;
+    }
+
+    throw std::invalid_argument("Invalid Huffman code");
+  }
+
+  void _Stored()
+  {
+    // Stored blocks start on a byte boundary.
+    _bits = 0;
+    _count = 0;
+    if (_data.size() - _pos < 4)
+    {
+      throw std::invalid_argument("Truncated stored block");
+    }
+
+    const uint16_t kLength = _data[_pos] | (_data[_pos + 1] << 8);
+    const uint16_t kComplement = _data[_pos + 2] | (_data[_pos + 3] << 8);
+    _pos += 4;
+    if (kLength != static_cast<uint16_t>(~kComplement) || kLength > _data.size() - _pos)
+    {
+      throw std::invalid_argument("Invalid stored block");
+    }
+
+    _Reserve(kLength);
+    _out.insert(std::end(_out), _data.begin() + _pos, _data.begin() + _pos + kLength);
+    _pos += kLength;
+  }
+
+  void _Codes(const Huffman &lengths, const Huffman &distances)
+  {
+    for (;;)
+    {
+      int symbol = _Decode(lengths);
+      if (symbol < 256)
+      {
+        _Reserve(1);
+        _out.push_back(static_cast<uint8_t>(symbol));
+        continue;
+      }
+
+      if (symbol == 256)
+      {
+        return;
+      }
+
+      symbol -= 257;
+      if (symbol >= static_cast<int>(std::size(kLengthBase)))
+      {
+        throw std::invalid_argument("Invalid length code");
+      }
+      const std::size_t kLength = kLengthBase[symbol] + _Bits(kLengthExtra[symbol]);
+
+      symbol = _Decode(distances);
+      if (symbol >= kMaxDistanceCodes)
+      {
+        throw std::invalid_argument("Invalid distance code");
+      }
+      const std::size_t kDistance = kDistanceBase[symbol] + _Bits(kDistanceExtra[symbol]);
+      if (kDistance > _out.size())
+      {
+        throw std::invalid_argument("Distance too far back");
+      }
+
+      // The source may overlap what is being written, copy byte by byte.
+      _Reserve(kLength);
+      for (std::size_t i = 0; i < kLength; i++)
+      {
+        _out.push_back(_out[_out.size() - kDistance]);
+      }
+    }
+  }
+
+  void _Fixed()
+  {
+    static const Huffman kLengths = []()
+    {
+      uint8_t lengths[kFixedLengthCodes];
+      std::fill(lengths, lengths + 144, 8);
+      std::fill(lengths + 144, lengths + 256, 9);
+      std::fill(lengths + 256, lengths + 280, 7);
+      std::fill(lengths + 280, lengths + kFixedLengthCodes, 8);
+      return Huffman{lengths, kFixedLengthCodes};
+    }();
+    static const Huffman kDistances = []()
+    {
+      uint8_t lengths[kMaxDistanceCodes];
+      std::fill(lengths, lengths + kMaxDistanceCodes, 5);
+      return Huffman{lengths, kMaxDistanceCodes};
+    }();
+
+    _Codes(kLengths, kDistances);
+  }
+
+  void _Dynamic()
+  {
+    const int kLengthCount = static_cast<int>(_Bits(5)) + 257;
+    const int kDistanceCount = static_cast<int>(_Bits(5)) + 1;
+    const int kCodeCount = static_cast<int>(_Bits(4)) + 4;
+    if (kLengthCount > kMaxLengthCodes || kDistanceCount > kMaxDistanceCodes)
+    {
+      throw std::invalid_argument("Too many codes in dynamic block");
+    }
+
+    uint8_t lengths[kMaxLengthCodes + kMaxDistanceCodes] = {};
+    for (int i = 0; i < kCodeCount; i++)
+    {
+      lengths[kCodeLengthOrder[i]] = static_cast<uint8_t>(_Bits(3));
+    }
+    const Huffman kCodeLengths{lengths, static_cast<int>(std::size(kCodeLengthOrder))};
+
+    // Literal/length and distance code lengths are sent as one sequence,
+    // with runs encoded by symbols 16 to 18.
+    int i = 0;
+    while (i < kLengthCount + kDistanceCount)
+    {
+      int symbol = _Decode(kCodeLengths);
+      if (symbol < 16)
+      {
+        lengths[i++] = static_cast<uint8_t>(symbol);
+        continue;
+      }
+
+      uint8_t length = 0;
+      int repeat;
+      if (symbol == 16)
+      {
+        if (i == 0)
+        {
+          throw std::invalid_argument("Repeat with no previous length");
+        }
+        length = lengths[i - 1];
+        repeat = 3 + static_cast<int>(_Bits(2));
+      } else if (symbol == 17)
+      {
+        repeat = 3 + static_cast<int>(_Bits(3));
+      } else
+      {
+        repeat = 11 + static_cast<int>(_Bits(7));
+      }
+
+      if (i + repeat > kLengthCount + kDistanceCount)
+      {
+        throw std::invalid_argument("Too many code lengths");
+      }
+      std::fill(lengths + i, lengths + i + repeat, length);
+      i += repeat;
+    }
+
+    if (lengths[256] == 0)
+    {
+      throw std::invalid_argument("Missing end of block code");
+    }
+
+    _Codes(Huffman{lengths, kLengthCount}, Huffman{lengths + kLengthCount, kDistanceCount});
+  }
+
+public:
+  Inflater(const std::span<const uint8_t> data, std::vector<uint8_t> &out, const std::size_t limit)
+      : _data(data),
+        _pos(0),
+        _bits(0),
+        _count(0),
+        _out(out),
+        _limit(limit)
+  {
+  }
+
+  void Run()
+  {
+    bool last;
+    do
+    {
+      last = _Bits(1);
+      switch (_Bits(2))
+      {
+        case 0:
+          _Stored();
+          break;
+        case 1:
+          _Fixed();
+          break;
+        case 2:
+          _Dynamic();
+          break;
+        default:
+          throw std::invalid_argument("Invalid deflate block type");
+      }
+    } while (!last);
+  }
+};
+}
+
+std::vector<uint8_t> CppDuke::Inflate(const std::span<const uint8_t> data, const std::size_t size)
+{
+  std::vector<uint8_t> out;
+  out.reserve(size);
+  Inflater{data, out, size}.Run();
+  if (out.size() != size)
+  {
+    throw std::invalid_argument("Inflated size does not match");
+  }
+
+  return out;
+}
@@ -0,0 +1,14 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+#include <vector>
+
+namespace CppDuke
+{
+// Decompresses raw DEFLATE data (RFC 1951), the way zip archives store it.
+// size is the expected length of the output. Throws std::invalid_argument
+// if the data is malformed or does not decompress to exactly size bytes,
+// without writing out more than size bytes first.
+std::vector<uint8_t> Inflate(std::span<const uint8_t> data, std::size_t size);
+}
@@ -1,106 +1,130 @@
 #include "klass.hpp"
 
 CppDuke::Klass::Klass(
-  const std::string &name,
-  std::vector<std::shared_ptr<ConstantPool::PoolEntry>> pool,
-  std::vector<ConstantPool::CommonRef> fields,
-  std::vector<ConstantPool::CommonRef> methods,
-  std::vector<ConstantPool::CommonAttribute> attributes)
+  Symbol name,
+  ClassFile file,
+  Arena arena,
+  ConstantPool::Pool pool,
+  std::span<const ConstantPool::CommonRef> fields,
+  std::span<const ConstantPool::CommonRef> methods,
+  std::span<const ConstantPool::CommonAttribute> attributes)
   : _name(name),
-    _entryPoint(nullptr),
+    _file(std::move(file)),
+    _arena(std::move(arena)),
+    _entryPoint(MemberIndex::kNotFound),
     _pool(pool),
     _fields(fields),
     _methods(methods),
+    _signatures(_arena.Allocate<const MethodSignature *>(methods.size()), methods.size()),
+    _codes(_arena.Allocate<const ConstantPool::CodeAttribute *>(methods.size()), methods.size()),
     _attributes(attributes) // PSVM
 {
+  _fieldIndex.Reserve(_fields.size());
+  for (const ConstantPool::CommonRef &f: _fields)
+  {
+    _fieldIndex.Add(SymbolAt(f.NameIndex()), SymbolAt(f.DescIndex()));
+  }
+  _fieldIndex.Build();
+
+  static const Symbol kMain = SymbolTable::Intern("main");
+  static const Symbol kMainDesc = SymbolTable::Intern("([Ljava/lang/String;)V");
+  static const Symbol kCode = SymbolTable::Intern("Code");
+  _methodIndex.Reserve(_methods.size());
+  for (std::size_t i = 0; i < _methods.size(); i++)
+  {
+    const ConstantPool::CommonRef &m = _methods[i];
+    const Symbol kName = SymbolAt(m.NameIndex());
+    const Symbol kDesc = SymbolAt(m.DescIndex());
+    _signatures[i] = &MethodSignature::Intern(kDesc);
+
+    const ConstantPool::CodeAttribute *code = nullptr;
+    for (const ConstantPool::CommonAttribute &attr: m.GetChildAttributes())
+    {
+      if (attr.Name() == kCode)
+      {
+        code = attr.GetCodeAttribute();
+        break;
+      }
+    }
+    _codes[i] = code;
+
+    if (kName == kMain && kDesc == kMainDesc && m.Flags() == (0x0001 | 0x0008))
+    {
+      _entryPoint = i;
+    }
+
+    _methodIndex.Add(kName, kDesc);
+  }
+  _methodIndex.Build();
 }
 
-std::vector<std::shared_ptr<CppDuke::ConstantPool::PoolEntry>>
-CppDuke::Klass::Pool() const
+const CppDuke::ConstantPool::Pool &CppDuke::Klass::Pool() const
 {
   return _pool;
 }
 
-std::vector<CppDuke::ConstantPool::CommonRef>
+std::span<const CppDuke::ConstantPool::CommonRef>
 CppDuke::Klass::Fields() const
 {
   return _fields;
 }
 
-std::vector<CppDuke::ConstantPool::CommonRef>
+std::span<const CppDuke::ConstantPool::CommonRef>
 CppDuke::Klass::Methods() const
 {
   return _methods;
 }
 
-std::string
+std::span<const CppDuke::MethodSignature *const>
+CppDuke::Klass::Signatures() const
+{
+  return _signatures;
+}
+
+std::span<const CppDuke::ConstantPool::CodeAttribute *const>
+CppDuke::Klass::Codes() const
+{
+  return _codes;
+}
+
+std::span<const CppDuke::ConstantPool::CommonAttribute>
+CppDuke::Klass::Attributes() const
+{
+  return _attributes;
+}
+
+CppDuke::Symbol
 CppDuke::Klass::Name() const
 {
   return _name;
 }
 
-std::shared_ptr<CppDuke::ConstantPool::CodeAttribute>
-CppDuke::Klass::GetEntryPoint() const
+std::span<const uint8_t> CppDuke::Klass::Bytes() const
+{
+  return _file.Bytes();
+}
+
+std::size_t CppDuke::Klass::GetEntryPoint() const
 {
   return _entryPoint;
 }
 
-std::shared_ptr<CppDuke::ConstantPool::GenericEntry> CppDuke::Klass::ResolveLowHigh(const int idx) const
+std::size_t CppDuke::Klass::MetadataBytes() const
 {
-  auto nameTpe = std::dynamic_pointer_cast<ConstantPool::GenericEntry>(_pool[idx - 1])->High();
-  return std::dynamic_pointer_cast<ConstantPool::GenericEntry>(_pool[nameTpe - 1]);
+  return _arena.Reserved() + _methodIndex.Bytes() + _fieldIndex.Bytes();
 }
 
-std::string CppDuke::Klass::Ldc(const int idx) const
+std::size_t CppDuke::Klass::FindMethod(const Symbol name, const Symbol descriptor) const
 {
-  std::shared_ptr<ConstantPool::GenericEntry> genEntry = std::dynamic_pointer_cast<ConstantPool::GenericEntry>(
-      _pool[idx - 1]);
-  return std::dynamic_pointer_cast<ConstantPool::Utf8>(_pool[genEntry->Low() - 1])->Data();
+  return _methodIndex.Find(name, descriptor);
 }
 
-std::shared_ptr<CppDuke::ConstantPool::CodeAttribute>
-CppDuke::Klass::Invoke(const uint16_t nameIdx, const uint16_t descIdx, int &argCount) const
+std::size_t CppDuke::Klass::FindField(const Symbol name, const Symbol descriptor) const
 {
-  auto itr = std::find_if(std::begin(_methods),
-                          std::end(_methods),
-                          [&](const ConstantPool::CommonRef &cref) -> bool
-                          {
-                            return cref.NameIndex() == nameIdx && cref.DescIndex() == descIdx;
-                          });
-
-  argCount = 0;
-  if (itr != std::end(_methods))
-  {
-    for (const ConstantPool::CommonAttribute &attr: itr->GetChildAttributes())
-    {
-      if (attr.Name() == "Code")
-      {
-        const std::string kDesc = std::dynamic_pointer_cast<ConstantPool::Utf8>(_pool[descIdx - 1])->Data();
-
-        char *p = const_cast<char *>(kDesc.c_str());
-        while (*p != ')')
-        {
-          switch (*p++)
-          {
-            case 'B':
-            case 'C':
-            case 'D':
-            case 'F':
-            case 'I':
-            case 'J':
-            case 'S':
-            case 'Z':
-              argCount++;
-            default:
-              // TODO: expand support
-              break;
-          }
-        }
-
-        return attr.GetCodeAttribute();
-      }
-    }
-  }
+  return _fieldIndex.Find(name, descriptor);
+}
 
-  throw std::invalid_argument("Could not look up method");
-}
\ No newline at end of file
+CppDuke::Symbol CppDuke::Klass::SymbolAt(const int idx) const
+{
+  return _pool.Utf8(idx);
+}
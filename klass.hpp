@@ -1,38 +1,73 @@
 #pragma once
 
+#include "arena.hpp"
+#include "classfile.hpp"
 #include "cpool.hpp"
+#include "index.hpp"
+#include "signature.hpp"
 
-#include <vector>
+#include <span>
 
 namespace CppDuke
 {
 class Klass
 {
-  std::string _name;
-  std::shared_ptr<ConstantPool::CodeAttribute> _entryPoint;
-  std::vector<std::shared_ptr<ConstantPool::PoolEntry>> _pool;
-  std::vector<ConstantPool::CommonRef> _fields, _methods;
-  std::vector<ConstantPool::CommonAttribute> _attributes;
+  Symbol _name;
+  // Code attributes are views into the file.
+  ClassFile _file;
+  // Owns the pool, members, attributes and code below, they all go with it.
+  Arena _arena;
+  std::size_t _entryPoint;
+  ConstantPool::Pool _pool;
+  std::span<const ConstantPool::CommonRef> _fields, _methods;
+  // Parsed descriptor and code of each method, in the same order as _methods.
+  std::span<const MethodSignature *> _signatures;
+  std::span<const ConstantPool::CodeAttribute *> _codes;
+  std::span<const ConstantPool::CommonAttribute> _attributes;
+  // Positions in _methods and _fields by name and descriptor.
+  MemberIndex _methodIndex, _fieldIndex;
 
 public:
-  explicit Klass(const std::string &name,
-                 std::vector<std::shared_ptr<ConstantPool::PoolEntry>> pool,
-                 std::vector<ConstantPool::CommonRef> fields,
-                 std::vector<ConstantPool::CommonRef> methods,
-                 std::vector<ConstantPool::CommonAttribute> attributes);
-
-  std::vector<std::shared_ptr<ConstantPool::PoolEntry>> Pool() const;
-  std::vector<ConstantPool::CommonRef> Fields() const;
-  std::vector<ConstantPool::CommonRef> Methods() const;
-  std::string Name() const;
-
-  std::shared_ptr<ConstantPool::CodeAttribute> GetEntryPoint() const;
-  std::shared_ptr<ConstantPool::GenericEntry> ResolveLowHigh(const int idx) const;
-
-  // Eq to VM's opcodes.
-  std::string Ldc(const int idx) const;
-  std::shared_ptr<ConstantPool::CodeAttribute> Invoke(const uint16_t nameIdx,
-                                                      const uint16_t descIdx,
-                                                      int &argCount) const;
+  // Metadata is immutable and referred to by address, a class is moved into
+  // its registry once and never copied.
+  Klass(const Klass &) = delete;
+  Klass &operator=(const Klass &) = delete;
+  Klass(Klass &&) = default;
+  Klass &operator=(Klass &&) = delete;
+
+  // pool, fields, methods and attributes must live in arena or file.
+  explicit Klass(Symbol name,
+                 ClassFile file,
+                 Arena arena,
+                 ConstantPool::Pool pool,
+                 std::span<const ConstantPool::CommonRef> fields,
+                 std::span<const ConstantPool::CommonRef> methods,
+                 std::span<const ConstantPool::CommonAttribute> attributes);
+
+  const ConstantPool::Pool &Pool() const;
+  std::span<const ConstantPool::CommonRef> Fields() const;
+  std::span<const ConstantPool::CommonRef> Methods() const;
+  std::span<const MethodSignature *const> Signatures() const;
+  // Null for abstract and native methods.
+  std::span<const ConstantPool::CodeAttribute *const> Codes() const;
+  std::span<const ConstantPool::CommonAttribute> Attributes() const;
+  Symbol Name() const;
+
+  // The class file the class was parsed from. Empty if it was not parsed
+  // but mapped from a shared archive.
+  std::span<const uint8_t> Bytes() const;
+
+  // Position of public static void main(String[]) in Methods(),
+  // MemberIndex::kNotFound if there is none.
+  std::size_t GetEntryPoint() const;
+
+  // Heap bytes held by the metadata of this class.
+  std::size_t MetadataBytes() const;
+
+  // Positions in Methods() and Fields(), MemberIndex::kNotFound if missing.
+  std::size_t FindMethod(Symbol name, Symbol descriptor) const;
+  std::size_t FindField(Symbol name, Symbol descriptor) const;
+
+  Symbol SymbolAt(const int idx) const;
 };
 }
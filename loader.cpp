@@ -0,0 +1,155 @@
+#include "loader.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <optional>
+#include <stdexcept>
+#include <thread>
+
+#include "parser.hpp"
+
+CppDuke::KlassLoader::KlassLoader(const unsigned threads,
+                                  const ClassPath *classPath,
+                                  const bool prefetch,
+                                  const SharedArchive *shared)
+    : _threads(threads ? threads : std::max(std::thread::hardware_concurrency(), 1u)),
+      _classPath(classPath),
+      _shared(shared)
+{
+  if (prefetch && _classPath != nullptr)
+  {
+    _prefetcher = std::make_unique<Prefetcher>(*_classPath, _threads, _shared);
+  }
+}
+
+void CppDuke::KlassLoader::Load(const std::vector<std::string> &paths, KlassRegistry &registry) const
+{
+  std::vector<std::optional<Klass>> klasses(paths.size());
+  std::vector<std::exception_ptr> errors(paths.size());
+  std::atomic<std::size_t> next{0};
+
+  // Files are handed out one at a time, so a few large ones do not leave
+  // the other threads idle.
+  auto work = [&]()
+  {
+    for (std::size_t i = next++; i < paths.size(); i = next++)
+    {
+      try
+      {
+        klasses[i].emplace(Parser{paths[i]}.Parse());
+      } catch (...)
+      {
+        errors[i] = std::current_exception();
+      }
+    }
+  };
+
+  // The calling thread is one of the workers.
+  const std::size_t kWorkers = std::min<std::size_t>(_threads, paths.size());
+  std::vector<std::thread> workers;
+  for (std::size_t i = 1; i < kWorkers; i++)
+  {
+    workers.emplace_back(work);
+  }
+  work();
+  for (std::thread &worker: workers)
+  {
+    worker.join();
+  }
+
+  for (const std::exception_ptr &error: errors)
+  {
+    if (error)
+    {
+      std::rethrow_exception(error);
+    }
+  }
+
+  for (std::optional<Klass> &klass: klasses)
+  {
+    const Klass &added = registry.Add(std::move(*klass));
+    if (_prefetcher)
+    {
+      _prefetcher->Enqueue(added);
+    }
+  }
+}
+
+std::optional<CppDuke::Klass> CppDuke::KlassLoader::_Parse(const Symbol name) const
+{
+  if (_shared)
+  {
+    if (std::optional<Klass> klass = _shared->Load(name, *_classPath))
+    {
+      return klass;
+    }
+  }
+
+  if (_prefetcher)
+  {
+    if (std::optional<Klass> klass = _prefetcher->Take(name))
+    {
+      return klass;
+    }
+  }
+
+  std::optional<ClassFile> file = _classPath->Open(*name);
+  if (!file)
+  {
+    return std::nullopt;
+  }
+
+  return Parser{std::move(*file)}.Parse();
+}
+
+const CppDuke::Klass *CppDuke::KlassLoader::Load(const Symbol name, KlassRegistry &registry) const
+{
+  if (const Klass *klass = registry.Find(name))
+  {
+    return klass;
+  }
+
+  if (_classPath == nullptr)
+  {
+    return nullptr;
+  }
+
+  std::optional<Klass> klass;
+  try
+  {
+    std::optional<Klass> parsed = _Parse(name);
+    if (!parsed)
+    {
+      return nullptr;
+    }
+
+    klass.emplace(std::move(*parsed));
+  } catch (const std::invalid_argument &e)
+  {
+    throw std::runtime_error("java.lang.ClassFormatError: " + *name + ": " + e.what());
+  }
+
+  if (klass->Name() != name)
+  {
+    throw std::runtime_error("java.lang.NoClassDefFoundError: " + *name + " (wrong name: " + *klass->Name() + ")");
+  }
+
+  const Klass &added = registry.Add(std::move(*klass));
+  if (_prefetcher)
+  {
+    _prefetcher->Enqueue(added);
+  }
+
+  return &added;
+}
+
+unsigned CppDuke::KlassLoader::Threads() const
+{
+  return _threads;
+}
+
+CppDuke::Prefetcher *CppDuke::KlassLoader::GetPrefetcher() const
+{
+  return _prefetcher.get();
+}
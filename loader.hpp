@@ -0,0 +1,60 @@
+#pragma once
+
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "classpath.hpp"
+#include "prefetch.hpp"
+#include "registry.hpp"
+#include "shared.hpp"
+
+namespace CppDuke
+{
+// Loads classes, either all at once from files given up front or one at a
+// time from a class path when they are first referenced.
+//
+// Files given up front are parsed on a pool of threads. Parsing is
+// independent per file, only the symbol table and the signature cache are
+// shared, and both lock.
+class KlassLoader
+{
+  unsigned _threads;
+  const ClassPath *_classPath;
+  // Null unless prefetching was asked for.
+  std::unique_ptr<Prefetcher> _prefetcher;
+  // Consulted before the class path, null without -Xshare:on.
+  const SharedArchive *_shared;
+
+  // Parses name from the class path, none if it is not there.
+  std::optional<Klass> _Parse(Symbol name) const;
+
+public:
+  // Zero threads means one per core. Without a class path only classes that
+  // were loaded up front can be found. With prefetch, classes referred to by
+  // loaded ones are parsed ahead on threads of their own. Classes in shared
+  // whose class files did not change are taken from it instead of parsed.
+  explicit KlassLoader(unsigned threads = 0,
+                       const ClassPath *classPath = nullptr,
+                       bool prefetch = false,
+                       const SharedArchive *shared = nullptr);
+
+  // Parses every path and adds the classes to registry in the order given,
+  // so the outcome never depends on which thread finished first. If some
+  // file cannot be parsed, rethrows the error of the first such path and
+  // adds nothing.
+  void Load(const std::vector<std::string> &paths, KlassRegistry &registry) const;
+
+  // The class named name, looked up in registry first. Otherwise it is read
+  // from the class path, parsed and added to registry. Null if it is on
+  // neither. Throws java.lang.ClassFormatError if the class cannot be
+  // parsed.
+  const Klass *Load(Symbol name, KlassRegistry &registry) const;
+
+  unsigned Threads() const;
+
+  // Null if not prefetching.
+  Prefetcher *GetPrefetcher() const;
+};
+}
@@ -1,28 +1,542 @@
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <chrono>
+#include <cstdio>
+#include <limits>
+#include <fstream>
 #include <iostream>
+#include <iterator>
+#include <memory>
+#include <optional>
+#include <sstream>
+#include <stdexcept>
+#include <string_view>
+#include <vector>
 
+#include "classpath.hpp"
 #include "klass.hpp"
-#include "parser.hpp"
+#include "loader.hpp"
+#include "pool.hpp"
+#include "registry.hpp"
+#include "server.hpp"
+#include "shared.hpp"
 #include "vm.hpp"
 
 using namespace CppDuke;
 
+// Digits and nothing else, nothing if s is not a number that fits _Ty.
+template<typename _Ty>
+static std::optional<_Ty> ParseNumber(const std::string_view s)
+{
+  _Ty value;
+  const auto [kEnd, kError] = std::from_chars(s.data(), s.data() + s.size(), value);
+  if (kError != std::errc{} || kEnd != s.data() + s.size())
+  {
+    return std::nullopt;
+  }
+
+  return value;
+}
+
+// Reads the number opt gives after its first prefix characters into value.
+// False once the error has been printed if it does not give one.
+template<typename _Ty>
+static bool ParseNumericOption(const std::string_view opt, const std::size_t prefix, _Ty &value)
+{
+  const std::optional<_Ty> kValue = ParseNumber<_Ty>(opt.substr(prefix));
+  if (!kValue)
+  {
+    std::cerr << "Invalid value in option: " << opt << "\n";
+    return false;
+  }
+
+  value = *kValue;
+  return true;
+}
+
+// Parses sizes the way the JVM does, e.g. 512k or 8m. Nothing if s is not
+// one or does not fit.
+static std::optional<std::size_t> ParseSize(std::string_view s)
+{
+  std::size_t unit = 1;
+  if (!s.empty())
+  {
+    switch (s.back())
+    {
+      case 'k':
+      case 'K':
+        unit = 1 << 10;
+        break;
+      case 'm':
+      case 'M':
+        unit = 1 << 20;
+        break;
+      case 'g':
+      case 'G':
+        unit = 1 << 30;
+        break;
+    }
+  }
+
+  if (unit != 1)
+  {
+    s.remove_suffix(1);
+  }
+
+  const std::optional<std::size_t> kSize = ParseNumber<std::size_t>(s);
+  if (!kSize || *kSize > std::numeric_limits<std::size_t>::max() / unit)
+  {
+    return std::nullopt;
+  }
+
+  return *kSize * unit;
+}
+
+// What one run of a program may choose, on the command line or in a request
+// to the server. Everything else concerns the classes and is set once.
+struct RunOptions
+{
+  std::size_t stackSize = VirtualMachine::Interpreter::kDefaultStackSize;
+  bool stats = false, trace = false, checked = false, safepoints = false;
+  std::size_t ngrams = 0;
+  // Started threads run as green threads on this many carriers, zero for
+  // one per core.
+  std::optional<unsigned> carriers;
+};
+
+typedef enum : uint8_t
+{
+  PARSED,
+  UNRECOGNIZED,
+  // Recognized, but its value is not valid. The error has been printed.
+  INVALID,
+} OptionResult;
+
+static OptionResult ParseRunOption(const std::string_view opt, RunOptions &options)
+{
+  if (opt.starts_with("-Xss"))
+  {
+    const std::optional<std::size_t> kSize = ParseSize(opt.substr(4));
+    if (!kSize || *kSize < VirtualMachine::Interpreter::kMinStackSize)
+    {
+      std::cerr << "Invalid thread stack size: " << opt << "\n";
+      return INVALID;
+    }
+    options.stackSize = *kSize;
+  } else if (opt == "-Xstats")
+  {
+    options.stats = true;
+  } else if (opt == "-Xtrace")
+  {
+    options.trace = true;
+  } else if (opt == "-Xcheck")
+  {
+    options.checked = true;
+  } else if (opt == "-Xsafepoints")
+  {
+    options.safepoints = true;
+  } else if (opt.starts_with("-Xngrams:"))
+  {
+    if (!ParseNumericOption(opt, 9, options.ngrams))
+    {
+      return INVALID;
+    }
+  } else if (opt == "-Xgreen")
+  {
+    options.carriers = 0;
+  } else if (opt.starts_with("-Xgreen:"))
+  {
+    unsigned carriers;
+    if (!ParseNumericOption(opt, 8, carriers))
+    {
+      return INVALID;
+    }
+    options.carriers = carriers;
+  } else
+  {
+    return UNRECOGNIZED;
+  }
+
+  return PARSED;
+}
+
+// Runs main in a new interpreter and returns the exit status.
+static int Run(KlassRegistry &klasses,
+               const KlassLoader &loader,
+               std::string main,
+               const RunOptions &options,
+               const std::chrono::steady_clock::time_point launched)
+{
+  // The main class may be named as in Java source, com.example.Main.
+  std::replace(std::begin(main), std::end(main), '.', '/');
+
+  try
+  {
+    VirtualMachine::Interpreter interpreter(klasses, loader, main, options.stackSize);
+    if (options.stats)
+    {
+      interpreter.EnableStats(launched);
+    }
+
+    if (options.ngrams)
+    {
+      interpreter.ProfileNgrams(options.ngrams);
+    }
+
+    if (options.trace)
+    {
+      interpreter.EnableTrace();
+    }
+
+    if (options.checked)
+    {
+      interpreter.EnableChecks();
+    }
+
+    if (options.safepoints)
+    {
+      interpreter.EnableSafepoints();
+    }
+
+    if (options.carriers)
+    {
+      interpreter.EnableGreenThreads(*options.carriers);
+    }
+
+    if (!interpreter.Run())
+    {
+      return 1;
+    }
+  } catch (const std::runtime_error &e)
+  {
+    std::cerr << "Exception in thread \"main\" " << e.what() << "\n";
+    return 1;
+  } catch (const std::exception &e)
+  {
+    // What the VM itself cannot handle, such as an unsupported opcode.
+    std::cerr << "Error: " << e.what() << "\n";
+    return 1;
+  }
+
+  return 0;
+}
+
+// Runs one request: run options followed by the main class.
+static int RunRequest(KlassRegistry &klasses, const KlassLoader &loader, const std::vector<std::string> &args)
+{
+  const auto kReceived = std::chrono::steady_clock::now();
+  RunOptions options;
+  std::size_t i = 0;
+  for (; i < args.size() && args[i].starts_with('-'); i++)
+  {
+    const OptionResult kResult = ParseRunOption(args[i], options);
+    if (kResult == UNRECOGNIZED)
+    {
+      std::cerr << "Unrecognized option: " << args[i] << "\n";
+    }
+    if (kResult != PARSED)
+    {
+      return 1;
+    }
+  }
+
+  if (i == args.size())
+  {
+    std::cerr << "Missing arguments\n";
+    return 1;
+  }
+
+  return Run(klasses, loader, args[i], options, kReceived);
+}
+
+// Runs every line of file, run options followed by the main class, side by
+// side on a pool of threads. All of them share the classes in klasses.
+// Returns the exit status, non zero if some run failed.
+static int RunBatch(KlassRegistry &klasses,
+                    const KlassLoader &loader,
+                    const std::string &file,
+                    const unsigned threads,
+                    const bool stats)
+{
+  std::ifstream stream;
+  if (file != "-")
+  {
+    stream.open(file);
+    if (!stream)
+    {
+      std::cerr << "Error: Cannot read batch file: " << file << "\n";
+      return 1;
+    }
+  }
+  std::istream &in = file == "-" ? std::cin : stream;
+
+  std::vector<std::vector<std::string>> jobs;
+  for (std::string line; std::getline(in, line);)
+  {
+    std::istringstream words{line};
+    std::vector<std::string> args{std::istream_iterator<std::string>{words}, {}};
+    if (!args.empty() && !args[0].starts_with('#'))
+    {
+      jobs.push_back(std::move(args));
+    }
+  }
+
+  const auto kStart = std::chrono::steady_clock::now();
+  std::atomic<std::size_t> failed{0};
+  WorkPool pool{threads};
+  for (std::size_t i = 0; i < jobs.size(); i++)
+  {
+    pool.Submit([&, i]()
+                {
+                  int status;
+                  try
+                  {
+                    status = RunRequest(klasses, loader, jobs[i]);
+                  } catch (const std::exception &e)
+                  {
+                    std::cerr << "Error: " << e.what() << "\n";
+                    status = 1;
+                  }
+
+                  if (status != 0)
+                  {
+                    fprintf(stderr, "Job %zu (%s) failed with status %d\n", i + 1, jobs[i].back().c_str(), status);
+                    failed++;
+                  }
+                });
+  }
+  pool.Wait();
+
+  if (stats)
+  {
+    const std::chrono::duration<double, std::milli> kElapsed = std::chrono::steady_clock::now() - kStart;
+    const WorkPool::Stats kPool = pool.Report();
+    fprintf(stderr,
+            "Ran %zu jobs in %.3f ms on %u threads, %llu stolen, %zu failed\n",
+            jobs.size(),
+            kElapsed.count(),
+            pool.Threads(),
+            static_cast<unsigned long long>(kPool.stolen),
+            failed.load());
+  }
+
+  return failed ? 1 : 0;
+}
+
 int main(int argc, char **argv)
 {
-  if (argc < 3)
+  const auto kLaunched = std::chrono::steady_clock::now();
+  RunOptions options;
+  bool prefetch = false;
+  unsigned loadThreads = 0;
+  std::optional<std::string> classPath;
+  bool dump = false, share = false;
+  std::string sharedArchive = "classes.jsa";
+  std::optional<std::string> socket;
+  std::optional<std::string> batch;
+  unsigned batchThreads = 0;
+
+  int i = 1;
+  for (; i < argc && argv[i][0] == '-'; i++)
+  {
+    std::string_view opt = argv[i];
+    const OptionResult kResult = ParseRunOption(opt, options);
+    if (kResult == INVALID)
+    {
+      return 1;
+    }
+    if (kResult == PARSED)
+    {
+      continue;
+    }
+
+    if (opt.starts_with("-Xloadthreads:"))
+    {
+      if (!ParseNumericOption(opt, 14, loadThreads))
+      {
+        return 1;
+      }
+    } else if (opt == "-Xprefetch")
+    {
+      prefetch = true;
+    } else if (opt == "-Xshare:dump")
+    {
+      dump = true;
+      share = false;
+    } else if (opt == "-Xshare:on")
+    {
+      share = true;
+      dump = false;
+    } else if (opt == "-Xshare:off")
+    {
+      share = dump = false;
+    } else if (opt.starts_with("-Xsharedarchive:"))
+    {
+      sharedArchive = opt.substr(16);
+    } else if (opt.starts_with("-Xserver:"))
+    {
+      socket = opt.substr(9);
+    } else if (opt.starts_with("-Xbatch:"))
+    {
+      batch = opt.substr(8);
+    } else if (opt.starts_with("-Xbatchthreads:"))
+    {
+      if (!ParseNumericOption(opt, 15, batchThreads))
+      {
+        return 1;
+      }
+    } else if (opt == "-cp" || opt == "-classpath")
+    {
+      if (++i == argc)
+      {
+        std::cerr << opt << " requires class path specification\n";
+        return 1;
+      }
+      classPath = argv[i];
+    } else
+    {
+      std::cerr << "Unrecognized option: " << opt << "\n";
+      return 1;
+    }
+  }
+
+  // A server or a batch takes the main class with each request, everything
+  // given is a class to load.
+  const bool kRequests = socket || batch;
+  if (!kRequests && argc - i < 1)
   {
     std::cerr << "Missing arguments\n";
     return 1;
   }
 
-  std::vector<Klass> klasses;
-  for (int i = 2; i < argc; i++)
+  const std::string kMain = kRequests ? "" : argv[i++];
+
+  // Class files named after the main class are loaded up front, everything
+  // else comes from the class path on first use. Like the JVM, look in the
+  // current directory if neither was given.
+  const std::vector<std::string> kFiles(argv + i, argv + argc);
+  if (!classPath && kFiles.empty())
+  {
+    classPath = ".";
+  }
+
+  // Classes taken from the shared archive point into its mapping, so it is
+  // made before and goes after the registry.
+  std::unique_ptr<const SharedArchive> shared;
+  KlassRegistry klasses;
+  std::unique_ptr<const ClassPath> path;
+  std::unique_ptr<const KlassLoader> loader;
+  try
+  {
+    if (classPath)
+    {
+      path = std::make_unique<const ClassPath>(*classPath);
+    }
+
+    if (share)
+    {
+      shared = std::make_unique<const SharedArchive>(sharedArchive);
+    }
+
+    // Workers would not survive the fork of each request.
+    loader = std::make_unique<const KlassLoader>(loadThreads, path.get(), prefetch && !socket, shared.get());
+    loader->Load(kFiles, klasses);
+  } catch (const std::invalid_argument &e)
+  {
+    std::cerr << "Error: " << e.what() << "\n";
+    return 1;
+  }
+
+  // A server loads the whole class path once, so that no request has to.
+  // Classes that fail to load are left to fail again where they are used.
+  if (socket && path)
+  {
+    for (const std::string &name: path->Names())
+    {
+      try
+      {
+        loader->Load(SymbolTable::Intern(name), klasses);
+      } catch (const std::runtime_error &)
+      {
+      }
+    }
+  }
+
+  if (options.stats)
   {
-    klasses.emplace_back(Parser{argv[i]}.Parse());
+    const std::chrono::duration<double, std::milli> kElapsed = std::chrono::steady_clock::now() - kLaunched;
+    fprintf(stderr,
+            "Loaded %zu classes up front in %.3f ms on %u threads\n",
+            klasses.Size(),
+            kElapsed.count(),
+            loader->Threads());
   }
 
-  // Typical hack for now.
-  // This is not how JVM finds class files.
-  VirtualMachine::Interpreter(klasses, argv[1]).Run();
+  if (batch)
+  {
+    return RunBatch(klasses, *loader, *batch, batchThreads, options.stats);
+  }
+
+  if (socket)
+  {
+    try
+    {
+      Server server{*socket};
+      server.Serve([&](const std::vector<std::string> &args)
+                   {
+                     return RunRequest(klasses, *loader, args);
+                   });
+    } catch (const std::invalid_argument &e)
+    {
+      std::cerr << "Error: " << e.what() << "\n";
+      return 1;
+    }
+
+    return 0;
+  }
+
+  if (Run(klasses, *loader, kMain, options, kLaunched) != 0)
+  {
+    return 1;
+  }
+
+  if (dump)
+  {
+    try
+    {
+      const std::size_t kDumped = SharedArchive::Dump(klasses, sharedArchive);
+      if (options.stats)
+      {
+        fprintf(stderr, "Dumped %zu classes to %s\n", kDumped, sharedArchive.c_str());
+      }
+    } catch (const std::invalid_argument &e)
+    {
+      std::cerr << "Error: " << e.what() << "\n";
+      return 1;
+    }
+  }
+
+  if (options.stats && shared)
+  {
+    const SharedArchive::Stats kShared = shared->Report();
+    fprintf(stderr,
+            "Shared %llu of %zu archived classes, %llu stale\n",
+            static_cast<unsigned long long>(kShared.shared),
+            shared->Size(),
+            static_cast<unsigned long long>(kShared.stale));
+  }
+
+  if (options.stats && loader->GetPrefetcher())
+  {
+    const Prefetcher::Stats kPrefetched = loader->GetPrefetcher()->Report();
+    fprintf(stderr,
+            "Prefetched %llu classes (%llu waited for), %llu misses, %llu wasted\n",
+            static_cast<unsigned long long>(kPrefetched.hits),
+            static_cast<unsigned long long>(kPrefetched.waits),
+            static_cast<unsigned long long>(kPrefetched.misses),
+            static_cast<unsigned long long>(kPrefetched.wasted));
+  }
 
   return 0;
 }
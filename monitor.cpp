@@ -0,0 +1,199 @@
+#include "monitor.hpp"
+
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace
+{
+std::atomic<uintptr_t> nextOwner{1};
+std::atomic<uint64_t> inflated{0};
+
+static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t));
+
+// Sleeps while word still holds value.
+void Wait(std::atomic<uint32_t> &word, const uint32_t value)
+{
+  syscall(SYS_futex, reinterpret_cast<uint32_t *>(&word), FUTEX_WAIT_PRIVATE, value, nullptr, nullptr, 0);
+}
+
+void WakeOne(std::atomic<uint32_t> &word)
+{
+  syscall(SYS_futex, reinterpret_cast<uint32_t *>(&word), FUTEX_WAKE_PRIVATE, 1, nullptr, nullptr, 0);
+}
+}
+
+namespace CppDuke::VirtualMachine
+{
+// A lock that was contended. The futex word is free, held, or held with
+// threads sleeping on it, so an exit only makes a system call when someone
+// has to be woken.
+class Monitor
+{
+  typedef enum : uint32_t
+  {
+    FREE = 0,
+    HELD,
+    CONTENDED,
+  } State;
+
+  std::atomic<uint32_t> _state;
+  // Only ever equal to a thread's own id while that thread holds it.
+  std::atomic<uintptr_t> _owner;
+  // Re-entries, only touched by the owner.
+  uintptr_t _count;
+
+public:
+  // Starts out held the way the thin lock it replaces was.
+  explicit Monitor(const uintptr_t owner, const uintptr_t count) : _state(HELD), _owner(owner), _count(count)
+  {}
+
+  bool Enter(const uintptr_t self, const bool wait)
+  {
+    if (_owner.load(std::memory_order_relaxed) == self)
+    {
+      _count++;
+      return true;
+    }
+
+    uint32_t state = FREE;
+    if (!_state.compare_exchange_strong(state, HELD, std::memory_order_acquire))
+    {
+      if (!wait)
+      {
+        return false;
+      }
+
+      // Whoever releases next has to wake a sleeper, this thread included.
+      if (state != CONTENDED)
+      {
+        state = _state.exchange(CONTENDED, std::memory_order_acquire);
+      }
+      while (state != FREE)
+      {
+        Wait(_state, CONTENDED);
+        state = _state.exchange(CONTENDED, std::memory_order_acquire);
+      }
+    }
+
+    _owner.store(self, std::memory_order_relaxed);
+    _count = 0;
+    return true;
+  }
+
+  bool Exit(const uintptr_t self)
+  {
+    if (_owner.load(std::memory_order_relaxed) != self)
+    {
+      return false;
+    }
+
+    if (_count)
+    {
+      _count--;
+      return true;
+    }
+
+    _owner.store(0, std::memory_order_relaxed);
+    if (_state.exchange(FREE, std::memory_order_release) == CONTENDED)
+    {
+      WakeOne(_state);
+    }
+
+    return true;
+  }
+};
+}
+
+CppDuke::VirtualMachine::Lock::~Lock()
+{
+  const uintptr_t kWord = _word.load(std::memory_order_relaxed);
+  if (kWord & kInflated)
+  {
+    delete reinterpret_cast<Monitor *>(kWord & ~kInflated);
+  }
+}
+
+uintptr_t CppDuke::VirtualMachine::Lock::NewOwner()
+{
+  return nextOwner.fetch_add(1, std::memory_order_relaxed) << kOwnerShift;
+}
+
+bool CppDuke::VirtualMachine::Lock::_Enter(uintptr_t word, const uintptr_t owner, const bool wait)
+{
+  for (;;)
+  {
+    if (word & kInflated)
+    {
+      return reinterpret_cast<Monitor *>(word & ~kInflated)->Enter(owner, wait);
+    }
+
+    if (word == 0)
+    {
+      if (_word.compare_exchange_weak(word, owner, std::memory_order_acquire, std::memory_order_acquire))
+      {
+        return true;
+      }
+      continue;
+    }
+
+    const uintptr_t kOwner = word & ~(kMaxCount | kInflated);
+    const uintptr_t kCount = word & kMaxCount;
+    if (kOwner == owner && kCount < kMaxCount)
+    {
+      // Swapped rather than stored, another thread may be inflating it.
+      if (_word.compare_exchange_weak(word, word + kCountUnit, std::memory_order_acquire, std::memory_order_acquire))
+      {
+        return true;
+      }
+      continue;
+    }
+
+    // Nobody to wait for, a thread that cannot block simply comes back.
+    if (kOwner != owner && !wait)
+    {
+      return false;
+    }
+
+    // Held by another thread, or re-entered more often than a thin lock
+    // counts. The monitor takes over the lock as it is.
+    auto *monitor = new Monitor(kOwner, kCount / kCountUnit);
+    const uintptr_t kFat = reinterpret_cast<uintptr_t>(monitor) | kInflated;
+    if (_word.compare_exchange_strong(word, kFat, std::memory_order_acq_rel, std::memory_order_acquire))
+    {
+      inflated.fetch_add(1, std::memory_order_relaxed);
+      return monitor->Enter(owner, wait);
+    }
+
+    // Released, re-entered or inflated meanwhile, look again.
+    delete monitor;
+  }
+}
+
+bool CppDuke::VirtualMachine::Lock::_Exit(uintptr_t word, const uintptr_t owner)
+{
+  for (;;)
+  {
+    if (word & kInflated)
+    {
+      return reinterpret_cast<Monitor *>(word & ~kInflated)->Exit(owner);
+    }
+
+    if ((word & ~(kMaxCount | kInflated)) != owner)
+    {
+      return false;
+    }
+
+    // Re-entries count down, the last exit frees it.
+    const uintptr_t kNext = word & kMaxCount ? word - kCountUnit : 0;
+    if (_word.compare_exchange_weak(word, kNext, std::memory_order_release, std::memory_order_acquire))
+    {
+      return true;
+    }
+  }
+}
+
+uint64_t CppDuke::VirtualMachine::Lock::Inflated()
+{
+  return inflated.load(std::memory_order_relaxed);
+}
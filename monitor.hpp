@@ -0,0 +1,75 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+namespace CppDuke::VirtualMachine
+{
+class Monitor;
+
+// The monitor every object carries, a single word that starts out as a thin
+// lock: the owning Java thread and how many times it re-entered, or zero
+// when free. Taking and releasing a free lock is one compare and swap each.
+// Owners are Java threads rather than OS threads, a green thread may move
+// between carriers while it holds a lock.
+//
+// A thread that finds the lock held by another inflates it: it moves the
+// owner and count into a fat monitor and swings the word to point at it,
+// then blocks on the monitor's futex. The owner notices when its own swap
+// fails and releases through the monitor. A lock never deflates, once it
+// was contended it stays fat until its object goes.
+class Lock
+{
+  std::atomic<uintptr_t> _word;
+
+  // Thin words hold the owner above kOwnerShift and the count in between.
+  // Fat words hold the address of the monitor, tagged with kInflated.
+  static constexpr uintptr_t kInflated = 1;
+  static constexpr uintptr_t kCountUnit = 2;
+  static constexpr uintptr_t kOwnerShift = 8;
+  static constexpr uintptr_t kMaxCount = (uintptr_t{1} << kOwnerShift) - kCountUnit;
+
+  // Blocks unless wait is false, then it fails instead.
+  bool _Enter(uintptr_t word, uintptr_t owner, bool wait);
+  bool _Exit(uintptr_t word, uintptr_t owner);
+
+public:
+  Lock() : _word(0)
+  {}
+
+  Lock(const Lock &) = delete;
+  Lock &operator=(const Lock &) = delete;
+  ~Lock();
+
+  // A new owner id, nonzero and different from every other.
+  static uintptr_t NewOwner();
+
+  void Enter(const uintptr_t owner)
+  {
+    uintptr_t word = 0;
+    if (!_word.compare_exchange_strong(word, owner, std::memory_order_acquire, std::memory_order_acquire))
+    {
+      _Enter(word, owner, true);
+    }
+  }
+
+  // False if another owner holds the lock.
+  bool TryEnter(const uintptr_t owner)
+  {
+    uintptr_t word = 0;
+    return _word.compare_exchange_strong(word, owner, std::memory_order_acquire, std::memory_order_acquire)
+           || _Enter(word, owner, false);
+  }
+
+  // False if owner does not hold the lock.
+  bool Exit(const uintptr_t owner)
+  {
+    uintptr_t word = owner;
+    return _word.compare_exchange_strong(word, 0, std::memory_order_release, std::memory_order_acquire)
+           || _Exit(word, owner);
+  }
+
+  // Locks inflated so far, by any thread.
+  static uint64_t Inflated();
+};
+}
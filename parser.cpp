@@ -10,17 +10,36 @@
 #include <endian.h>
 #endif
 
+#include <algorithm>
+#include <cstring>
+#include <memory>
 #include <unordered_map>
 
 using namespace CppDuke;
 
+// Metadata takes up to three times the size of the class file, most classes
+// fit in the first chunk of their arena.
+Parser::Parser(ClassFile file) :
+    _file(std::move(file)),
+    _bytes(_file.Bytes()),
+    _pos(0),
+    _arena(3 * _bytes.size() + 256)
+{}
+
 Parser::Parser(const std::string &klassFile) :
-    _fd(fopen(klassFile.c_str(), "r"))
+    Parser(ClassFile::Map(klassFile))
 {}
 
-Parser::~Parser()
+std::span<const uint8_t> Parser::_Take(const std::size_t count)
 {
-  fclose(_fd);
+  if (count > _bytes.size() - _pos)
+  {
+    throw std::invalid_argument("Truncated class file at offset " + std::to_string(_pos));
+  }
+
+  std::span<const uint8_t> bytes = _bytes.subspan(_pos, count);
+  _pos += count;
+  return bytes;
 }
 
 template<typename T>
@@ -30,14 +49,14 @@ T Parser::_Read()
       std::is_same_v<T, uint8_t>
       || std::is_same_v<T, uint16_t>
       || std::is_same_v<T, uint32_t>);
-  const unsigned long dwSize = sizeof(T);
 
+  // Class files are not aligned, copy the bytes out before swapping them.
   T bits;
-  fread(&bits, dwSize, /* nitems = */1, _fd);
-  if (std::is_same_v<T, uint16_t>)
+  std::memcpy(&bits, _Take(sizeof(T)).data(), sizeof(T));
+  if constexpr (std::is_same_v<T, uint16_t>)
   {
     bits = be16toh(bits);
-  } else if (std::is_same_v<T, uint32_t>)
+  } else if constexpr (std::is_same_v<T, uint32_t>)
   {
     bits = be32toh(bits);
   }
@@ -52,59 +71,67 @@ void Parser::_ParseHeaders()
   (void) _Read<uint16_t>(); // Skip max version
 }
 
-std::vector<std::shared_ptr<ConstantPool::PoolEntry>>
-Parser::_ParseConstantPool()
+ConstantPool::Pool Parser::_ParseConstantPool()
 {
   uint16_t tableSize = _Read<uint16_t>();
-  std::vector<std::shared_ptr<ConstantPool::PoolEntry>> pool;
-  pool.resize(tableSize);
+  ConstantPool::Pool::Entry *entries = _arena.Allocate<ConstantPool::Pool::Entry>(tableSize);
+  std::fill_n(entries, tableSize, ConstantPool::Pool::Entry{{}, ConstantPool::EMPTY});
 
-  for (int i = 0; i < tableSize - 1; i++)
+  for (int i = 1; i < tableSize; i++)
   {
     uint8_t tag = _Read<uint8_t>();
-    if (tag < ConstantPool::UTF_8 || tag > 18)
-    {
-      throw std::invalid_argument("Invalid tag: " + std::to_string(tag));
-    }
+    ConstantPool::Pool::Entry &entry = entries[i];
+    entry.tag = static_cast<ConstantPool::EntryType>(tag);
 
     switch (tag)
     {
       case ConstantPool::EntryType::UTF_8:
       {
-        uint16_t sLen = _Read<uint16_t>();
-        std::string s;
-        s.resize(sLen);
+        // Interned straight from the file, only new symbols are copied.
+        std::span<const uint8_t> s = _Take(_Read<uint16_t>());
+        entry.utf8 = SymbolTable::Intern({reinterpret_cast<const char *>(s.data()), s.size()});
+        break;
+      }
 
-        for (int j = 0; j < sLen; j++)
-        {
-          s[j] = _Read<uint8_t>();
-        }
+      case ConstantPool::EntryType::INTEGER:
+      {
+        entry.i = static_cast<int32_t>(_Read<uint32_t>());
+        break;
+      }
 
-        pool[i] = std::make_shared<ConstantPool::Utf8>(s);
+      case ConstantPool::EntryType::FLOAT:
+      {
+        uint32_t bits = _Read<uint32_t>();
+        std::memcpy(&entry.f, &bits, sizeof(bits));
         break;
       }
 
+      case ConstantPool::EntryType::LONG:
       case ConstantPool::EntryType::CONST_DOUBLE:
       {
-        uint16_t high = _Read<uint16_t>();
-        uint16_t low = _Read<uint16_t>();
+        uint64_t high = _Read<uint32_t>();
+        uint64_t bits = high << 32 | _Read<uint32_t>();
+        std::memcpy(&entry.l, &bits, sizeof(bits));
 
-        // Use high and low to construct the double value.
-        pool[i] = std::make_shared<ConstantPool::GenericEntry>(high, low);
+        // Eight byte constants take two slots, the second one is unusable.
+        i++;
         break;
       }
 
       case ConstantPool::EntryType::CLASS:
+      case ConstantPool::EntryType::STRING:
+      case ConstantPool::EntryType::METHOD_TYPE:
+      case ConstantPool::EntryType::MODULE:
+      case ConstantPool::EntryType::PACKAGE:
       {
-        pool[i] = std::make_shared<ConstantPool::KlassInfo>(_Read<uint16_t>());
+        entry.ref = {_Read<uint16_t>(), 0};
         break;
       }
 
-      case ConstantPool::EntryType::STRING:
+      case ConstantPool::EntryType::METHOD_HANDLE:
       {
-        pool[i] = std::make_shared<ConstantPool::GenericEntry>(_Read<uint16_t>(), // Index
-                                                               0 // Ignore, zero value
-        );
+        uint16_t kind = _Read<uint8_t>();
+        entry.ref = {kind, _Read<uint16_t>()};
         break;
       }
 
@@ -112,24 +139,29 @@ Parser::_ParseConstantPool()
       case ConstantPool::EntryType::METHOD_REF:
       case ConstantPool::EntryType::INTERFACE_REF:
       case ConstantPool::EntryType::NAME_TYPE_REF:
+      case ConstantPool::EntryType::DYNAMIC:
+      case ConstantPool::EntryType::INVOKE_DYNAMIC:
       {
-        pool[i] = std::make_shared<ConstantPool::GenericEntry>(
-            _Read<uint16_t>(), // Class index
-            _Read<uint16_t>() // Name type index
-        );
+        // Read into locals, argument evaluation order is unspecified.
+        uint16_t first = _Read<uint16_t>();
+        uint16_t second = _Read<uint16_t>();
+        entry.ref = {first, second};
         break;
       }
+
+      default:
+        throw std::invalid_argument("Invalid tag: " + std::to_string(tag));
     } // parsing done
   } // loop
 
-  return pool;
+  return ConstantPool::Pool{{entries, tableSize}};
 }
 
 void Parser::_ParseMeta()
 {
   (void) _Read<uint16_t>();
   _this = _Read<uint16_t>();
-  (void) _Read<uint16_t>();
+  _super = _Read<uint16_t>();
 
   uint16_t infLen = _Read<uint16_t>();
   for (int i = 0; i < infLen; i++)
@@ -138,124 +170,112 @@ void Parser::_ParseMeta()
   }
 }
 
-std::vector<ConstantPool::CommonRef> Parser::_ParseKlassFields(
-  const std::vector<std::shared_ptr<ConstantPool::PoolEntry>> &pool)
+std::span<const ConstantPool::CommonRef> Parser::_ParseKlassFields(
+  const ConstantPool::Pool &pool)
 {
   uint16_t length = _Read<uint16_t>();
-  std::vector<ConstantPool::CommonRef> fields;
+  ConstantPool::CommonRef *fields = _arena.Allocate<ConstantPool::CommonRef>(length);
   for (int i = 0; i < length; i++)
   {
-    fields.emplace_back(_ParseCommonFields(pool));
+    std::construct_at(&fields[i], _ParseCommonFields(pool));
   }
 
-  return fields;
+  return {fields, length};
 }
 
-std::vector<ConstantPool::CommonRef> Parser::_ParseMethods(
-  const std::vector<std::shared_ptr<ConstantPool::PoolEntry>> &pool)
+std::span<const ConstantPool::CommonRef> Parser::_ParseMethods(
+  const ConstantPool::Pool &pool)
 {
   uint16_t length = _Read<uint16_t>();
-  std::vector<ConstantPool::CommonRef> methods;
+  ConstantPool::CommonRef *methods = _arena.Allocate<ConstantPool::CommonRef>(length);
   for (int i = 0; i < length; i++)
   {
-    methods.emplace_back(_ParseCommonFields(pool));
+    std::construct_at(&methods[i], _ParseCommonFields(pool));
   }
 
-  return methods;
+  return {methods, length};
 }
 
-std::vector<ConstantPool::CommonAttribute> Parser::_ParseKlassAttributes(
-  const std::vector<std::shared_ptr<ConstantPool::PoolEntry>> &pool)
+std::span<const ConstantPool::CommonAttribute> Parser::_ParseKlassAttributes(
+  const ConstantPool::Pool &pool)
 {
   uint16_t length = _Read<uint16_t>();
-  std::vector<ConstantPool::CommonAttribute> attributes;
+  ConstantPool::CommonAttribute *attributes = _arena.Allocate<ConstantPool::CommonAttribute>(length);
   for (int i = 0; i < length; i++)
   {
-    attributes.emplace_back(_ParseAttribute(pool));
+    std::construct_at(&attributes[i], _ParseAttribute(pool));
   }
 
-  return attributes;
+  return {attributes, length};
 }
 
 ConstantPool::CommonAttribute Parser::_ParseAttribute(
-  const std::vector<std::shared_ptr<ConstantPool::PoolEntry>> &pool)
+  const ConstantPool::Pool &pool)
 {
+  static const Symbol kCode = SymbolTable::Intern("Code");
+
   uint16_t name = _Read<uint16_t>();
   uint32_t length = _Read<uint32_t>();
-  std::string s = std::dynamic_pointer_cast<ConstantPool::Utf8>(pool[name - 1])->Data();
+  Symbol s = pool.Utf8(name);
 
-  std::shared_ptr<ConstantPool::CodeAttribute> opt = nullptr;
-  if (s == "Code")
+  const ConstantPool::CodeAttribute *opt = nullptr;
+  if (s == kCode)
   {
-    opt = _ParseCodeAttribute(pool);
+    opt = _ParseCodeAttribute(length);
   } else
   {
-    for (int i = 0; i < length; i++)
-    {
-      (void) _Read<uint8_t>();
-    }
+    (void) _Take(length);
   }
 
   return ConstantPool::CommonAttribute{name, length, s, opt};
 }
 
-std::shared_ptr<ConstantPool::CodeAttribute> Parser::_ParseCodeAttribute(
-  const std::vector<std::shared_ptr<ConstantPool::PoolEntry>> &pool)
+const ConstantPool::CodeAttribute *Parser::_ParseCodeAttribute(uint32_t length)
 {
-  uint16_t stack = _Read<uint16_t>();
-  uint16_t local = _Read<uint16_t>();
-  uint32_t bcode = _Read<uint32_t>();
-
-  std::vector<uint8_t> code(bcode);
-  for (int i = 0; i < bcode; i++)
-  {
-    code[i] = _Read<uint8_t>();
-  }
-
-  uint16_t empty[_Read<uint16_t>() * 64];
-  (void) fread(empty, sizeof(empty), 1, _fd);
-
-  uint16_t ex = _Read<uint16_t>();
-  for (int i = 0; i < ex; i++)
-  {
-    (void) _ParseAttribute(pool);
-  }
-
-  return std::make_shared<ConstantPool::CodeAttribute>(stack, local, code);
+  // Most methods never run, the body is left as it is in the class file,
+  // which the class keeps alive, until the method is first invoked.
+  return _arena.New<ConstantPool::CodeAttribute>(_Take(length));
 }
 
 ConstantPool::CommonRef Parser::_ParseCommonFields(
-  const std::vector<std::shared_ptr<ConstantPool::PoolEntry>> &pool)
+  const ConstantPool::Pool &pool)
 {
   uint16_t flags = _Read<uint16_t>();
   uint16_t name = _Read<uint16_t>();
   uint16_t desc = _Read<uint16_t>();
   uint16_t length = _Read<uint16_t>();
 
-  std::vector<ConstantPool::CommonAttribute> attributes;
+  ConstantPool::CommonAttribute *attributes = _arena.Allocate<ConstantPool::CommonAttribute>(length);
   for (int j = 0; j < length; j++)
   {
-    attributes.emplace_back(_ParseAttribute(pool));
+    std::construct_at(&attributes[j], _ParseAttribute(pool));
   }
 
   return ConstantPool::CommonRef{flags,
                                  name,
                                  desc,
-                                 length,
-                                 attributes};
+                                 {attributes, length}};
 }
 
 Klass Parser::Parse()
 {
   _ParseHeaders();
-  std::vector<std::shared_ptr<ConstantPool::PoolEntry>> pool = _ParseConstantPool();
+  ConstantPool::Pool pool = _ParseConstantPool();
   _ParseMeta();
-  std::vector<ConstantPool::CommonRef> fields = _ParseKlassFields(pool);
-  std::vector<ConstantPool::CommonRef> methods = _ParseMethods(pool);
-  std::vector<ConstantPool::CommonAttribute> attributes = _ParseKlassAttributes(pool);
+  std::span<const ConstantPool::CommonRef> fields = _ParseKlassFields(pool);
+  std::span<const ConstantPool::CommonRef> methods = _ParseMethods(pool);
+  std::span<const ConstantPool::CommonAttribute> attributes = _ParseKlassAttributes(pool);
 
-  auto klassInfo = std::dynamic_pointer_cast<ConstantPool::KlassInfo>(pool[_this - 1]);
-  std::string name = std::dynamic_pointer_cast<ConstantPool::Utf8>(pool[klassInfo->NameIndex() - 1])->Data();
+  Symbol name = pool.KlassName(_this);
 
-  return Klass{name, pool, fields, methods, attributes};
-}
\ No newline at end of file
+  // Members are never inherited, a subclass would run and lay out as if it
+  // only had its own. Zero is java/lang/Object itself.
+  static const Symbol kObject = SymbolTable::Intern("java/lang/Object");
+  if (_super != 0 && pool.KlassName(_super) != kObject)
+  {
+    throw std::invalid_argument(*name + " extends " + *pool.KlassName(_super)
+                                + ", only java/lang/Object can be extended");
+  }
+
+  return Klass{name, std::move(_file), std::move(_arena), pool, fields, methods, attributes};
+}
@@ -1,6 +1,8 @@
 #pragma once
 
 #include <string>
+#include "arena.hpp"
+#include "classfile.hpp"
 #include "cpool.hpp"
 #include "klass.hpp"
 
@@ -8,48 +10,58 @@ namespace CppDuke
 {
 class Parser
 {
-  FILE* _fd;
-  uint16_t _this;
+  // Both the file and everything parsed from it go to the class at the end.
+  ClassFile _file;
+  std::span<const uint8_t> _bytes;
+  std::size_t _pos;
+  Arena _arena;
+  uint16_t _this, _super;
 
+  // Moves past the next count bytes and returns them, throws if the file
+  // ends before.
+  std::span<const uint8_t> _Take(std::size_t count);
+
+  // Next big-endian value, bounds checked as _Take.
   template<typename T>
   [[maybe_unused]] T _Read();
 
   void _ParseHeaders();
 
   [[nodiscard]]
-  std::vector<std::shared_ptr<ConstantPool::PoolEntry>> _ParseConstantPool();
+  ConstantPool::Pool _ParseConstantPool();
 
   void _ParseMeta();
 
   [[nodiscard]]
-  std::vector<ConstantPool::CommonRef>
-  _ParseKlassFields(const std::vector<std::shared_ptr<ConstantPool::PoolEntry>> &pool);
+  std::span<const ConstantPool::CommonRef>
+  _ParseKlassFields(const ConstantPool::Pool &pool);
 
   [[nodiscard]]
-  std::vector<ConstantPool::CommonRef>
-  _ParseMethods(const std::vector<std::shared_ptr<ConstantPool::PoolEntry>> &pool);
+  std::span<const ConstantPool::CommonRef>
+  _ParseMethods(const ConstantPool::Pool &pool);
 
   [[nodiscard]]
-  std::vector<ConstantPool::CommonAttribute>
-  _ParseKlassAttributes(const std::vector<std::shared_ptr<ConstantPool::PoolEntry>> &pool);
+  std::span<const ConstantPool::CommonAttribute>
+  _ParseKlassAttributes(const ConstantPool::Pool &pool);
 
   [[nodiscard]]
   ConstantPool::CommonAttribute
-  _ParseAttribute(const std::vector<std::shared_ptr<ConstantPool::PoolEntry>> &pool);
+  _ParseAttribute(const ConstantPool::Pool &pool);
 
   [[nodiscard]]
-  std::shared_ptr<ConstantPool::CodeAttribute>
-  _ParseCodeAttribute(const std::vector<std::shared_ptr<ConstantPool::PoolEntry>> &pool);
+  const ConstantPool::CodeAttribute *
+  _ParseCodeAttribute(uint32_t length);
 
   [[nodiscard]]
   ConstantPool::CommonRef
-  _ParseCommonFields(const std::vector<std::shared_ptr<ConstantPool::PoolEntry>> &pool);
+  _ParseCommonFields(const ConstantPool::Pool &pool);
 
 public:
+  // Maps klassFile, see ClassFile::Map.
   explicit Parser(const std::string &klassFile);
+  explicit Parser(ClassFile file);
 
+  // Once only, the class takes over the file.
   Klass Parse();
-
-  ~Parser();
 };
 }
@@ -0,0 +1,140 @@
+#include "pool.hpp"
+
+#include <algorithm>
+
+namespace
+{
+// Position of the worker running on this thread in the pool it belongs to.
+thread_local const CppDuke::WorkPool *currentPool = nullptr;
+thread_local std::size_t currentWorker = 0;
+}
+
+CppDuke::WorkPool::WorkPool(const unsigned threads)
+    : _queued(0),
+      _pending(0),
+      _next(0),
+      _executed(0),
+      _stolen(0),
+      _stopping(false)
+{
+  const unsigned kThreads = threads ? threads : std::max(std::thread::hardware_concurrency(), 1u);
+  for (unsigned i = 0; i < kThreads; i++)
+  {
+    _queues.push_back(std::make_unique<Queue>());
+  }
+
+  // Only started once every queue is there, workers steal from all of them.
+  for (unsigned i = 0; i < kThreads; i++)
+  {
+    _workers.emplace_back(&WorkPool::_Work, this, i);
+  }
+}
+
+CppDuke::WorkPool::~WorkPool()
+{
+  Wait();
+  {
+    std::lock_guard<std::mutex> guard{_lock};
+    _stopping = true;
+  }
+
+  _wake.notify_all();
+  for (std::thread &worker: _workers)
+  {
+    worker.join();
+  }
+}
+
+void CppDuke::WorkPool::Submit(Task task)
+{
+  const std::size_t kQueue = currentPool == this ? currentWorker : _next++ % _queues.size();
+  _pending++;
+  // Counted under the lock a sleeping worker checks it under, so the wake
+  // up cannot slip in between its check and its wait. Counted before it is
+  // queued, so taking it never drops the count below zero.
+  {
+    std::lock_guard<std::mutex> guard{_lock};
+    _queued++;
+  }
+
+  {
+    std::lock_guard<std::mutex> guard{_queues[kQueue]->lock};
+    _queues[kQueue]->tasks.push_back(std::move(task));
+  }
+  _wake.notify_one();
+}
+
+bool CppDuke::WorkPool::_Take(const std::size_t self, Task &task)
+{
+  {
+    Queue &own = *_queues[self];
+    std::lock_guard<std::mutex> guard{own.lock};
+    if (!own.tasks.empty())
+    {
+      task = std::move(own.tasks.back());
+      own.tasks.pop_back();
+      _queued--;
+      return true;
+    }
+  }
+
+  for (std::size_t i = 1; i < _queues.size(); i++)
+  {
+    Queue &other = *_queues[(self + i) % _queues.size()];
+    std::lock_guard<std::mutex> guard{other.lock};
+    if (!other.tasks.empty())
+    {
+      task = std::move(other.tasks.front());
+      other.tasks.pop_front();
+      _queued--;
+      _stolen++;
+      return true;
+    }
+  }
+
+  return false;
+}
+
+void CppDuke::WorkPool::_Work(const std::size_t self)
+{
+  currentPool = this;
+  currentWorker = self;
+  for (;;)
+  {
+    Task task;
+    if (_Take(self, task))
+    {
+      task();
+      _executed++;
+      if (--_pending == 0)
+      {
+        std::lock_guard<std::mutex> guard{_lock};
+        _done.notify_all();
+      }
+      continue;
+    }
+
+    std::unique_lock<std::mutex> guard{_lock};
+    _wake.wait(guard, [this]() { return _stopping || _queued > 0; });
+    if (_stopping && _queued == 0)
+    {
+      return;
+    }
+  }
+}
+
+void CppDuke::WorkPool::Wait()
+{
+  std::unique_lock<std::mutex> guard{_lock};
+  _done.wait(guard, [this]() { return _pending == 0; });
+}
+
+unsigned CppDuke::WorkPool::Threads() const
+{
+  return static_cast<unsigned>(_workers.size());
+}
+
+CppDuke::WorkPool::Stats CppDuke::WorkPool::Report() const
+{
+  return Stats{_executed, _stolen};
+}
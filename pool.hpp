@@ -0,0 +1,69 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace CppDuke
+{
+// Runs tasks on a fixed set of threads. Every worker has a queue of its own:
+// it takes its newest task first, and once its queue is empty it steals the
+// oldest task of another worker, so uneven tasks do not leave threads idle.
+// Tasks submitted from inside a task go to the queue of the worker running
+// it, tasks from outside are dealt out in turn.
+class WorkPool
+{
+public:
+  typedef std::function<void()> Task;
+
+  struct Stats
+  {
+    uint64_t executed, stolen;
+  };
+
+private:
+  struct Queue
+  {
+    std::mutex lock;
+    std::deque<Task> tasks;
+  };
+
+  std::vector<std::unique_ptr<Queue>> _queues;
+  std::vector<std::thread> _workers;
+
+  // Guards sleeping and waking, the queues lock on their own.
+  std::mutex _lock;
+  std::condition_variable _wake, _done;
+  // Submitted but not yet taken, and not yet finished.
+  std::atomic<std::size_t> _queued, _pending;
+  std::atomic<std::size_t> _next;
+  std::atomic<uint64_t> _executed, _stolen;
+  bool _stopping;
+
+  void _Work(std::size_t self);
+  bool _Take(std::size_t self, Task &task);
+
+public:
+  // Zero threads means one per core.
+  explicit WorkPool(unsigned threads = 0);
+  WorkPool(const WorkPool &) = delete;
+  WorkPool &operator=(const WorkPool &) = delete;
+  // Finishes every submitted task before the workers are joined.
+  ~WorkPool();
+
+  // Thread safe. Tasks must not throw.
+  void Submit(Task task);
+
+  // Blocks until every task submitted so far has finished.
+  void Wait();
+
+  unsigned Threads() const;
+  Stats Report() const;
+};
+}
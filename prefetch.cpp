@@ -0,0 +1,156 @@
+#include "prefetch.hpp"
+
+#include "parser.hpp"
+
+CppDuke::Prefetcher::Prefetcher(const ClassPath &classPath, const unsigned threads, const SharedArchive *shared)
+    : _classPath(classPath),
+      _shared(shared),
+      _stopping(false),
+      _hits(0),
+      _waits(0),
+      _misses(0)
+{
+  for (unsigned i = 0; i < threads; i++)
+  {
+    _workers.emplace_back(&Prefetcher::_Work, this);
+  }
+}
+
+CppDuke::Prefetcher::~Prefetcher()
+{
+  {
+    std::lock_guard<std::mutex> guard{_lock};
+    _stopping = true;
+  }
+
+  _queued.notify_all();
+  for (std::thread &worker: _workers)
+  {
+    worker.join();
+  }
+}
+
+void CppDuke::Prefetcher::_Work()
+{
+  std::unique_lock<std::mutex> guard{_lock};
+  for (;;)
+  {
+    _queued.wait(guard, [this]() { return _stopping || !_queue.empty(); });
+    if (_stopping)
+    {
+      return;
+    }
+
+    const Symbol kName = _queue.front();
+    _queue.pop_front();
+
+    // The loader may have got to it first.
+    Slot &slot = _slots.at(kName);
+    if (slot.taken)
+    {
+      continue;
+    }
+
+    // Parse without the lock, only the slot is shared. Nodes of the map
+    // never move, so the reference stays good while others are added.
+    slot.started = true;
+    guard.unlock();
+    std::optional<Klass> klass;
+    std::exception_ptr error;
+    try
+    {
+      std::optional<ClassFile> file = _classPath.Open(*kName);
+      if (file)
+      {
+        klass.emplace(Parser{std::move(*file)}.Parse());
+      }
+    } catch (...)
+    {
+      error = std::current_exception();
+    }
+    guard.lock();
+
+    if (klass)
+    {
+      slot.klass.emplace(std::move(*klass));
+    }
+    slot.error = error;
+    slot.done = true;
+    if (slot.klass)
+    {
+      _Enqueue(*slot.klass);
+    }
+    _parsed.notify_all();
+  }
+}
+
+void CppDuke::Prefetcher::_Enqueue(const Klass &klass)
+{
+  const ConstantPool::Pool &kPool = klass.Pool();
+  for (uint16_t i = 1; i < kPool.Size(); i++)
+  {
+    if (kPool.Tag(i) != ConstantPool::CLASS)
+    {
+      continue;
+    }
+
+    // Array classes and classes outside the class path are never loaded
+    // from it.
+    const Symbol kName = kPool.KlassName(i);
+    if (_classPath.Contains(*kName)
+        && (_shared == nullptr || !_shared->Contains(*kName))
+        && _slots.try_emplace(kName, Slot{std::nullopt, nullptr, false, false, false}).second)
+    {
+      _queue.push_back(kName);
+      _queued.notify_one();
+    }
+  }
+}
+
+void CppDuke::Prefetcher::Enqueue(const Klass &klass)
+{
+  std::lock_guard<std::mutex> guard{_lock};
+  _Enqueue(klass);
+}
+
+std::optional<CppDuke::Klass> CppDuke::Prefetcher::Take(const Symbol name)
+{
+  std::unique_lock<std::mutex> guard{_lock};
+  auto [itr, kAdded] = _slots.try_emplace(name, Slot{std::nullopt, nullptr, false, false, true});
+  Slot &slot = itr->second;
+  if (kAdded || slot.taken || !slot.started)
+  {
+    // Parsing it here is no slower than waiting for a worker to start.
+    // Claimed now so no worker parses it later for nothing.
+    slot.taken = true;
+    _misses++;
+    return std::nullopt;
+  }
+
+  slot.taken = true;
+  _hits++;
+  if (!slot.done)
+  {
+    _waits++;
+    _parsed.wait(guard, [&slot]() { return slot.done; });
+  }
+
+  if (slot.error)
+  {
+    std::rethrow_exception(slot.error);
+  }
+
+  return std::move(slot.klass);
+}
+
+CppDuke::Prefetcher::Stats CppDuke::Prefetcher::Report()
+{
+  std::lock_guard<std::mutex> guard{_lock};
+  uint64_t wasted = 0;
+  for (const auto &[name, slot]: _slots)
+  {
+    wasted += slot.done && !slot.taken;
+  }
+
+  return Stats{_hits, _waits, _misses, wasted};
+}
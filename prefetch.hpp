@@ -0,0 +1,83 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "classpath.hpp"
+#include "klass.hpp"
+#include "shared.hpp"
+
+namespace CppDuke
+{
+// Parses classes on background threads before they are needed. Every class
+// that gets parsed, here or by the loader, is scanned for the classes its
+// constant pool refers to, and those that are on the class path are queued.
+// By the time the interpreter first resolves one of them it is usually
+// parsed already and only has to be taken.
+class Prefetcher
+{
+public:
+  struct Stats
+  {
+    // Taken when asked for, and how many of those were still being parsed.
+    uint64_t hits, waits;
+    // Asked for before a worker got to them, the loader parsed them itself.
+    uint64_t misses;
+    // Parsed here but never asked for.
+    uint64_t wasted;
+  };
+
+private:
+  struct Slot
+  {
+    std::optional<Klass> klass;
+    std::exception_ptr error;
+    // A worker picked it up, and finished parsing it or failed to.
+    bool started, done;
+    // Handed to the loader, or claimed by it before being queued.
+    bool taken;
+  };
+
+  const ClassPath &_classPath;
+  // Classes it holds are cheaper to take from it than to parse, even ahead.
+  const SharedArchive *_shared;
+
+  std::mutex _lock;
+  std::condition_variable _queued, _parsed;
+  std::deque<Symbol> _queue;
+  // Every class that was queued or asked for, so none is parsed twice.
+  std::unordered_map<Symbol, Slot> _slots;
+  bool _stopping;
+  uint64_t _hits, _waits, _misses;
+
+  std::vector<std::thread> _workers;
+
+  void _Work();
+  // Queues what klass refers to. Must hold _lock.
+  void _Enqueue(const Klass &klass);
+
+public:
+  Prefetcher(const ClassPath &classPath, unsigned threads, const SharedArchive *shared = nullptr);
+  Prefetcher(const Prefetcher &) = delete;
+  Prefetcher &operator=(const Prefetcher &) = delete;
+  // Stops the workers, classes still queued are dropped.
+  ~Prefetcher();
+
+  // Queues the classes klass refers to.
+  void Enqueue(const Klass &klass);
+
+  // The class named name if it was queued, waiting for it if it is still
+  // being parsed. Rethrows the error if it failed to parse. None if it was
+  // never queued, it is then never parsed here either.
+  std::optional<Klass> Take(Symbol name);
+
+  Stats Report();
+};
+}
@@ -0,0 +1,37 @@
+#include "registry.hpp"
+
+#include <mutex>
+
+const CppDuke::Klass &CppDuke::KlassRegistry::Add(Klass klass)
+{
+  const Symbol kName = klass.Name();
+  std::unique_lock<std::shared_mutex> guard{_lock};
+  std::unique_ptr<const Klass> &slot = _klasses[kName];
+  if (slot)
+  {
+    return *slot;
+  }
+
+  slot = std::make_unique<const Klass>(std::move(klass));
+  _order.push_back(slot.get());
+  return *slot;
+}
+
+const CppDuke::Klass *CppDuke::KlassRegistry::Find(const Symbol name) const
+{
+  std::shared_lock<std::shared_mutex> guard{_lock};
+  auto itr = _klasses.find(name);
+  return itr == std::end(_klasses) ? nullptr : itr->second.get();
+}
+
+std::vector<const CppDuke::Klass *> CppDuke::KlassRegistry::Klasses() const
+{
+  std::shared_lock<std::shared_mutex> guard{_lock};
+  return _order;
+}
+
+std::size_t CppDuke::KlassRegistry::Size() const
+{
+  std::shared_lock<std::shared_mutex> guard{_lock};
+  return _order.size();
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <memory>
+#include <shared_mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "klass.hpp"
+
+namespace CppDuke
+{
+// Owns every loaded class. A class never moves once it is added, so the rest
+// of the VM refers to it by pointer or reference. Classes are immutable, one
+// registry is shared by every interpreter running at the same time, each of
+// which may load classes into it. Thread safe.
+class KlassRegistry
+{
+  mutable std::shared_mutex _lock;
+  std::unordered_map<Symbol, std::unique_ptr<const Klass>> _klasses;
+  // Same classes in the order they were added.
+  std::vector<const Klass *> _order;
+
+public:
+  // Takes over klass. If a class of the same name is there already it is
+  // kept and returned instead, the first definition wins as on a class path.
+  // Two threads loading the same class both get the one added first.
+  const Klass &Add(Klass klass);
+
+  // Null if no class of that name was added.
+  const Klass *Find(Symbol name) const;
+
+  // The classes added so far, in order.
+  std::vector<const Klass *> Klasses() const;
+  std::size_t Size() const;
+};
+}
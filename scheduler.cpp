@@ -0,0 +1,140 @@
+#include "scheduler.hpp"
+
+#include <algorithm>
+
+namespace
+{
+// The carrier running on this thread, and the green thread that yielded on
+// it during the current turn, if any.
+thread_local std::size_t currentCarrier = 0;
+thread_local std::coroutine_handle<> yielded = nullptr;
+}
+
+void CppDuke::Scheduler::Turn::await_suspend(const std::coroutine_handle<> handle) const noexcept
+{
+  // Queueing it here would let another carrier resume it before it is done
+  // suspending, its carrier does so once resume() returns.
+  yielded = handle;
+}
+
+CppDuke::Scheduler::Scheduler(const unsigned carriers, const std::chrono::microseconds quantum)
+    : _quantum(quantum),
+      _live(0),
+      _spawned(0),
+      _switches(0),
+      _stopping(false)
+{
+  const unsigned kCarriers = carriers ? carriers : std::max(std::thread::hardware_concurrency(), 1u);
+  _running = std::make_unique<std::atomic<std::atomic<bool> *>[]>(kCarriers);
+  for (unsigned i = 0; i < kCarriers; i++)
+  {
+    _running[i].store(nullptr, std::memory_order_relaxed);
+  }
+
+  for (unsigned i = 0; i < kCarriers; i++)
+  {
+    _carriers.emplace_back(&Scheduler::_Carry, this, i);
+  }
+  _ticker = std::thread(&Scheduler::_Tick, this);
+}
+
+CppDuke::Scheduler::~Scheduler()
+{
+  Wait();
+  {
+    std::lock_guard<std::mutex> guard{_lock};
+    _stopping = true;
+  }
+
+  _wake.notify_all();
+  _tick.notify_all();
+  for (std::thread &carrier: _carriers)
+  {
+    carrier.join();
+  }
+  _ticker.join();
+}
+
+void CppDuke::Scheduler::Spawn(const Green green)
+{
+  {
+    std::lock_guard<std::mutex> guard{_lock};
+    _ready.push_back(green.handle);
+    _live++;
+    _spawned++;
+  }
+  _wake.notify_one();
+}
+
+void CppDuke::Scheduler::_Carry(const std::size_t self)
+{
+  currentCarrier = self;
+  std::unique_lock<std::mutex> guard{_lock};
+  for (;;)
+  {
+    _wake.wait(guard, [this]() { return _stopping || !_ready.empty(); });
+    if (_ready.empty())
+    {
+      return;
+    }
+
+    const std::coroutine_handle<> kNext = _ready.front();
+    _ready.pop_front();
+    guard.unlock();
+
+    yielded = nullptr;
+    kNext.resume();
+    _running[self].store(nullptr, std::memory_order_relaxed);
+
+    // A green thread that did not yield has returned and freed itself. One
+    // that did is ready again, this carrier takes the next one right away,
+    // nobody else needs waking for it.
+    guard.lock();
+    if (yielded)
+    {
+      _ready.push_back(yielded);
+      _switches++;
+    } else if (--_live == 0)
+    {
+      _done.notify_all();
+    }
+  }
+}
+
+void CppDuke::Scheduler::_Tick()
+{
+  std::unique_lock<std::mutex> guard{_lock};
+  while (!_tick.wait_for(guard, _quantum, [this]() { return _stopping; }))
+  {
+    for (std::size_t i = 0; i < _carriers.size(); i++)
+    {
+      std::atomic<bool> *flag = _running[i].load(std::memory_order_relaxed);
+      if (flag != nullptr)
+      {
+        flag->store(true, std::memory_order_relaxed);
+      }
+    }
+  }
+}
+
+void CppDuke::Scheduler::Preemptible(std::atomic<bool> &flag)
+{
+  _running[currentCarrier].store(&flag, std::memory_order_relaxed);
+}
+
+void CppDuke::Scheduler::Wait()
+{
+  std::unique_lock<std::mutex> guard{_lock};
+  _done.wait(guard, [this]() { return _live == 0; });
+}
+
+unsigned CppDuke::Scheduler::Carriers() const
+{
+  return static_cast<unsigned>(_carriers.size());
+}
+
+CppDuke::Scheduler::Stats CppDuke::Scheduler::Report()
+{
+  std::lock_guard<std::mutex> guard{_lock};
+  return Stats{_spawned, _switches};
+}
@@ -0,0 +1,131 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <coroutine>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace CppDuke
+{
+// Runs green threads, coroutines that take turns on a few carrier threads.
+// A green thread runs until it yields, then goes to the back of a single
+// ready queue and the carrier resumes whichever one is at the front, so a
+// switch is a queue operation and never a system call. Whichever carrier is
+// free next picks it up again, a green thread is not tied to any of them.
+//
+// Nothing is ever interrupted. Each quantum the scheduler raises the flag a
+// green thread named in Preemptible(), it is up to the thread to notice and
+// yield.
+class Scheduler
+{
+public:
+  // What the body of a green thread returns. It starts out suspended until
+  // Spawn() queues it, and frees itself once the body returns.
+  struct Green
+  {
+    struct promise_type
+    {
+      Green get_return_object()
+      {
+        return Green{std::coroutine_handle<promise_type>::from_promise(*this)};
+      }
+
+      std::suspend_always initial_suspend() noexcept
+      {
+        return {};
+      }
+
+      std::suspend_never final_suspend() noexcept
+      {
+        return {};
+      }
+
+      void return_void()
+      {}
+
+      // Bodies catch what they throw, there is nobody to rethrow it to.
+      void unhandled_exception()
+      {
+        std::terminate();
+      }
+    };
+
+    std::coroutine_handle<> handle;
+  };
+
+  // Awaited by a green thread to give up its carrier. It is only queued
+  // again once it has fully suspended, by the carrier it ran on.
+  struct Turn
+  {
+    bool await_ready() const noexcept
+    {
+      return false;
+    }
+
+    void await_suspend(std::coroutine_handle<> handle) const noexcept;
+
+    void await_resume() const noexcept
+    {}
+  };
+
+  struct Stats
+  {
+    uint64_t spawned, switches;
+  };
+
+  static constexpr std::chrono::microseconds kDefaultQuantum{1000};
+
+private:
+  std::vector<std::thread> _carriers;
+  // Preemption flag of the green thread on each carrier, null while idle.
+  std::unique_ptr<std::atomic<std::atomic<bool> *>[]> _running;
+  std::thread _ticker;
+  const std::chrono::microseconds _quantum;
+
+  std::mutex _lock;
+  std::condition_variable _wake, _done, _tick;
+  std::deque<std::coroutine_handle<>> _ready;
+  // Spawned and not finished yet.
+  std::size_t _live;
+  uint64_t _spawned, _switches;
+  bool _stopping;
+
+  void _Carry(std::size_t self);
+  void _Tick();
+
+public:
+  // Zero carriers means one per core.
+  explicit Scheduler(unsigned carriers = 0, std::chrono::microseconds quantum = kDefaultQuantum);
+  Scheduler(const Scheduler &) = delete;
+  Scheduler &operator=(const Scheduler &) = delete;
+  // Runs every green thread to its end before the carriers are joined.
+  ~Scheduler();
+
+  // Thread safe, green threads may spawn others.
+  void Spawn(Green green);
+
+  // co_await Yield() gives up the carrier until every green thread ready
+  // before has had its turn.
+  static Turn Yield()
+  {
+    return Turn{};
+  }
+
+  // Called by a green thread each time it is resumed. flag is raised once
+  // it held its carrier for a quantum, and must outlive the scheduler.
+  void Preemptible(std::atomic<bool> &flag);
+
+  // Blocks until every green thread spawned so far has finished.
+  void Wait();
+
+  unsigned Carriers() const;
+  Stats Report();
+};
+}
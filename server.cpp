@@ -0,0 +1,315 @@
+#include "server.hpp"
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <csignal>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+
+namespace
+{
+// A request is the length of its text followed by the arguments, each ended
+// by a NUL. The client's stdin, stdout and stderr ride along with the
+// length. The reply is the exit status.
+constexpr std::size_t kStreams = 3;
+constexpr uint32_t kMaxRequest = 1 << 16;
+
+volatile std::sig_atomic_t stopping = 0;
+
+void Stop(int)
+{
+  stopping = 1;
+}
+
+sockaddr_un Address(const std::string &path)
+{
+  sockaddr_un address{};
+  address.sun_family = AF_UNIX;
+  if (path.empty() || path.size() >= sizeof(address.sun_path))
+  {
+    throw std::invalid_argument("Bad socket path: " + path);
+  }
+
+  std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+  return address;
+}
+
+bool SendAll(const int socket, const void *data, std::size_t size)
+{
+  const auto *bytes = static_cast<const char *>(data);
+  while (size)
+  {
+    const ssize_t kSent = send(socket, bytes, size, MSG_NOSIGNAL);
+    if (kSent < 0 && errno == EINTR)
+    {
+      continue;
+    }
+    if (kSent <= 0)
+    {
+      return false;
+    }
+    bytes += kSent;
+    size -= static_cast<std::size_t>(kSent);
+  }
+
+  return true;
+}
+
+bool ReceiveAll(const int socket, void *data, std::size_t size)
+{
+  auto *bytes = static_cast<char *>(data);
+  while (size)
+  {
+    const ssize_t kReceived = recv(socket, bytes, size, 0);
+    if (kReceived < 0 && errno == EINTR)
+    {
+      continue;
+    }
+    if (kReceived <= 0)
+    {
+      return false;
+    }
+    bytes += kReceived;
+    size -= static_cast<std::size_t>(kReceived);
+  }
+
+  return true;
+}
+
+// The length of the request along with the descriptors of the client.
+bool SendHeader(const int socket, const uint32_t length, const std::array<int, kStreams> &fds)
+{
+  uint32_t header = length;
+  iovec iov{&header, sizeof(header)};
+  alignas(cmsghdr) char control[CMSG_SPACE(sizeof(fds))]{};
+  msghdr message{};
+  message.msg_iov = &iov;
+  message.msg_iovlen = 1;
+  message.msg_control = control;
+  message.msg_controllen = sizeof(control);
+
+  cmsghdr *fdsHeader = CMSG_FIRSTHDR(&message);
+  fdsHeader->cmsg_level = SOL_SOCKET;
+  fdsHeader->cmsg_type = SCM_RIGHTS;
+  fdsHeader->cmsg_len = CMSG_LEN(sizeof(fds));
+  std::memcpy(CMSG_DATA(fdsHeader), fds.data(), sizeof(fds));
+
+  return sendmsg(socket, &message, MSG_NOSIGNAL) == sizeof(header);
+}
+
+bool ReceiveHeader(const int socket, uint32_t &length, std::array<int, kStreams> &fds)
+{
+  iovec iov{&length, sizeof(length)};
+  alignas(cmsghdr) char control[CMSG_SPACE(sizeof(fds))]{};
+  msghdr message{};
+  message.msg_iov = &iov;
+  message.msg_iovlen = 1;
+  message.msg_control = control;
+  message.msg_controllen = sizeof(control);
+
+  ssize_t received;
+  do
+  {
+    received = recvmsg(socket, &message, MSG_WAITALL | MSG_CMSG_CLOEXEC);
+  } while (received < 0 && errno == EINTR);
+
+  const cmsghdr *fdsHeader = CMSG_FIRSTHDR(&message);
+  if (fdsHeader == nullptr
+      || fdsHeader->cmsg_level != SOL_SOCKET
+      || fdsHeader->cmsg_type != SCM_RIGHTS
+      || fdsHeader->cmsg_len != CMSG_LEN(sizeof(fds)))
+  {
+    return false;
+  }
+
+  std::memcpy(fds.data(), CMSG_DATA(fdsHeader), sizeof(fds));
+  if (received != sizeof(length) || (message.msg_flags & MSG_CTRUNC))
+  {
+    for (const int fd: fds)
+    {
+      close(fd);
+    }
+    return false;
+  }
+
+  return true;
+}
+}
+
+CppDuke::Server::Server(const std::string &path)
+    : _path(path),
+      _socket(-1)
+{
+  const sockaddr_un kAddress = Address(path);
+  unlink(path.c_str());
+  _socket = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (_socket < 0
+      || bind(_socket, reinterpret_cast<const sockaddr *>(&kAddress), sizeof(kAddress)) != 0
+      || listen(_socket, SOMAXCONN) != 0)
+  {
+    const std::string kError = std::strerror(errno);
+    if (_socket >= 0)
+    {
+      close(_socket);
+    }
+    throw std::invalid_argument("Cannot listen on " + path + ": " + kError);
+  }
+}
+
+CppDuke::Server::~Server()
+{
+  close(_socket);
+  unlink(_path.c_str());
+}
+
+void CppDuke::Server::Serve(const Job &job)
+{
+  // Serving processes are reaped by the system, the server never waits.
+  signal(SIGCHLD, SIG_IGN);
+  // Not restarted, so a signal interrupts accept and the loop ends.
+  struct sigaction stop{};
+  stop.sa_handler = Stop;
+  sigaction(SIGINT, &stop, nullptr);
+  sigaction(SIGTERM, &stop, nullptr);
+
+  while (!stopping)
+  {
+    const int kConnection = accept4(_socket, nullptr, nullptr, SOCK_CLOEXEC);
+    if (kConnection < 0)
+    {
+      if (errno == EINTR || errno == ECONNABORTED)
+      {
+        continue;
+      }
+      throw std::invalid_argument("Cannot accept on " + _path + ": " + std::strerror(errno));
+    }
+
+    // Anything still buffered would be written again by the child.
+    fflush(nullptr);
+    const pid_t kPid = fork();
+    if (kPid == 0)
+    {
+      close(_socket);
+      signal(SIGINT, SIG_DFL);
+      signal(SIGTERM, SIG_DFL);
+      _exit(_Handle(kConnection, job));
+    }
+
+    close(kConnection);
+  }
+}
+
+int CppDuke::Server::_Handle(const int connection, const Job &job)
+{
+  uint32_t length;
+  std::array<int, kStreams> fds{};
+  if (!ReceiveHeader(connection, length, fds))
+  {
+    return 1;
+  }
+
+  std::string text(std::min(length, kMaxRequest), '\0');
+  if (length > kMaxRequest || !ReceiveAll(connection, text.data(), length))
+  {
+    for (const int fd: fds)
+    {
+      close(fd);
+    }
+    return 1;
+  }
+
+  std::vector<std::string> args;
+  for (std::size_t start = 0; start < text.size();)
+  {
+    const std::size_t kEnd = text.find('\0', start);
+    args.push_back(text.substr(start, kEnd - start));
+    start = kEnd == std::string::npos ? text.size() : kEnd + 1;
+  }
+
+  // The program runs in a process of its own, so the status can be sent
+  // even if it crashes.
+  signal(SIGCHLD, SIG_DFL);
+  const pid_t kPid = fork();
+  if (kPid == 0)
+  {
+    close(connection);
+    for (std::size_t i = 0; i < kStreams; i++)
+    {
+      dup2(fds[i], static_cast<int>(i));
+      close(fds[i]);
+    }
+
+    const int kStatus = job(args);
+    std::cout.flush();
+    fflush(nullptr);
+    _exit(kStatus);
+  }
+
+  int status = 1;
+  if (kPid < 0)
+  {
+    dprintf(fds[2], "Cannot run: %s\n", std::strerror(errno));
+  }
+
+  for (const int fd: fds)
+  {
+    close(fd);
+  }
+
+  if (kPid > 0)
+  {
+    while (waitpid(kPid, &status, 0) < 0 && errno == EINTR)
+    {
+    }
+    // As shells report it.
+    status = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+  }
+
+  const uint32_t kStatus = static_cast<uint32_t>(status);
+  SendAll(connection, &kStatus, sizeof(kStatus));
+  return 0;
+}
+
+int CppDuke::Server::Request(const std::string &path, const std::vector<std::string> &args)
+{
+  std::string text;
+  for (const std::string &arg: args)
+  {
+    text += arg;
+    text += '\0';
+  }
+
+  const sockaddr_un kAddress = Address(path);
+  const int kSocket = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (kSocket < 0 || connect(kSocket, reinterpret_cast<const sockaddr *>(&kAddress), sizeof(kAddress)) != 0)
+  {
+    const std::string kError = std::strerror(errno);
+    if (kSocket >= 0)
+    {
+      close(kSocket);
+    }
+    throw std::invalid_argument("Cannot reach server at " + path + ": " + kError);
+  }
+
+  uint32_t status;
+  const bool kDone = text.size() <= kMaxRequest
+                     && SendHeader(kSocket, static_cast<uint32_t>(text.size()), {0, 1, 2})
+                     && SendAll(kSocket, text.data(), text.size())
+                     && ReceiveAll(kSocket, &status, sizeof(status));
+  close(kSocket);
+  if (!kDone)
+  {
+    throw std::invalid_argument("Lost connection to server at " + path);
+  }
+
+  return static_cast<int>(status);
+}
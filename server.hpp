@@ -0,0 +1,50 @@
+#pragma once
+
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace CppDuke
+{
+// Runs programs on request over a Unix domain socket, so classes are loaded
+// once by the server instead of once per run.
+//
+// A client sends its arguments along with its standard input, output and
+// error. Each request is served in a process forked from the server: it
+// sees the classes as they were when the server started, shared copy on
+// write, and starts from a fresh interpreter whatever earlier requests did.
+// The forked process takes over the client's descriptors, so the program
+// writes straight to the client's terminal, and its exit status is sent
+// back once it is done. Requests run side by side.
+class Server
+{
+public:
+  // Runs one request with the arguments of the client and returns its exit
+  // status. Called in the forked process.
+  typedef std::function<int(const std::vector<std::string> &args)> Job;
+
+private:
+  std::string _path;
+  int _socket;
+
+  // Serves the client on connection, in its own process.
+  static int _Handle(int connection, const Job &job);
+
+public:
+  // Listens on path, replacing what is there. Throws std::invalid_argument
+  // if that is not possible.
+  explicit Server(const std::string &path);
+  Server(const Server &) = delete;
+  Server &operator=(const Server &) = delete;
+  ~Server();
+
+  // Serves requests until SIGINT or SIGTERM, requests being served then
+  // carry on. Throws std::invalid_argument if the socket fails.
+  void Serve(const Job &job);
+
+  // Sends args to the server at path and returns the exit status of the
+  // run, with the standard streams of the caller handed to it. Throws
+  // std::invalid_argument if the server cannot be reached.
+  static int Request(const std::string &path, const std::vector<std::string> &args);
+};
+}
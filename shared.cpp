@@ -0,0 +1,463 @@
+#include "shared.hpp"
+
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include <vector>
+
+#include "checksum.hpp"
+
+namespace
+{
+constexpr char kMagic[8] = {'C', 'P', 'P', 'D', 'U', 'K', 'E', 'S'};
+// Bumped whenever a record below changes.
+constexpr uint32_t kVersion = 1;
+// Records are written in the byte order of the machine that dumps them.
+constexpr uint32_t kByteOrder = 0x01020304;
+constexpr uint32_t kNoCode = static_cast<uint32_t>(-1);
+
+struct Header
+{
+  char magic[8];
+  uint32_t version, byteOrder;
+  uint64_t size;
+  uint64_t symbols, klasses;
+  uint32_t symbolCount, klassCount;
+};
+
+struct SymbolRecord
+{
+  uint64_t offset;
+  uint32_t length, unused;
+};
+
+// A constant pool entry. Text is the index of a symbol, references keep
+// first in the low half.
+struct EntryRecord
+{
+  uint64_t bits;
+  CppDuke::ConstantPool::EntryType tag;
+  uint8_t unused[7];
+};
+
+struct MemberRecord
+{
+  uint16_t flags, name, descriptor, attributes;
+};
+
+// code is the offset of the body of a Code attribute in the class file,
+// kNoCode for any other attribute.
+struct AttributeRecord
+{
+  uint16_t nameIndex, unused;
+  uint32_t length;
+  uint32_t code, codeSize;
+};
+
+// Appends records at offsets aligned for any of them.
+class Writer
+{
+  std::vector<uint8_t> _bytes;
+
+public:
+  uint64_t Append(const void *data, const std::size_t size)
+  {
+    _bytes.resize((_bytes.size() + 7) & ~std::size_t{7});
+    const uint64_t kOffset = _bytes.size();
+    _bytes.insert(std::end(_bytes), static_cast<const uint8_t *>(data), static_cast<const uint8_t *>(data) + size);
+    return kOffset;
+  }
+
+  template<typename _Ty>
+  uint64_t Append(const std::vector<_Ty> &records)
+  {
+    return Append(records.data(), records.size() * sizeof(_Ty));
+  }
+
+  std::vector<uint8_t> &Bytes()
+  {
+    return _bytes;
+  }
+};
+}
+
+struct CppDuke::SharedArchive::KlassRecord
+{
+  uint32_t name, checksum;
+  uint64_t file, fileSize;
+  uint64_t entries, members, attributes, attributeCount;
+  // Attributes of the class come first, then those of each field and method
+  // in order.
+  uint16_t poolSize, fields, methods, klassAttributes;
+};
+
+CppDuke::SharedArchive::SharedArchive(const std::string &path)
+    : _path(path),
+      _file(std::vector<uint8_t>{}),
+      _shared(0),
+      _stale(0)
+{
+  try
+  {
+    _file = ClassFile::Map(path);
+  } catch (const std::invalid_argument &)
+  {
+    throw std::invalid_argument("Cannot read shared archive: " + path);
+  }
+
+  _bytes = _file.Bytes();
+  Header header{};
+  if (_bytes.size() < sizeof(Header))
+  {
+    throw std::invalid_argument("Not a shared archive: " + path);
+  }
+
+  std::memcpy(&header, _bytes.data(), sizeof(Header));
+  if (std::memcmp(header.magic, kMagic, sizeof(kMagic)) != 0
+      || header.version != kVersion
+      || header.byteOrder != kByteOrder
+      || header.size != _bytes.size())
+  {
+    throw std::invalid_argument("Shared archive was not dumped by this VM: " + path);
+  }
+
+  _symbolCount = header.symbolCount;
+  _symbolTable = _Section(header.symbols, header.symbolCount, sizeof(SymbolRecord)).data();
+  _symbols = std::make_unique<std::atomic<Symbol>[]>(_symbolCount);
+
+  const auto *kKlasses = reinterpret_cast<const KlassRecord *>(
+      _Section(header.klasses, header.klassCount, sizeof(KlassRecord)).data());
+  _klasses.reserve(header.klassCount);
+  for (uint32_t i = 0; i < header.klassCount; i++)
+  {
+    _klasses.emplace(_Text(kKlasses[i].name), &kKlasses[i]);
+  }
+}
+
+std::span<const uint8_t> CppDuke::SharedArchive::_Section(const uint64_t offset,
+                                                          const uint64_t count,
+                                                          const std::size_t size) const
+{
+  if (offset % alignof(uint64_t) != 0 || offset > _bytes.size() || count > (_bytes.size() - offset) / size)
+  {
+    throw std::invalid_argument("Damaged shared archive: " + _path);
+  }
+
+  return _bytes.subspan(offset, count * size);
+}
+
+std::string_view CppDuke::SharedArchive::_Text(const uint32_t idx) const
+{
+  if (idx >= _symbolCount)
+  {
+    throw std::invalid_argument("Damaged shared archive: " + _path);
+  }
+
+  const SymbolRecord &kRecord = reinterpret_cast<const SymbolRecord *>(_symbolTable)[idx];
+  if (kRecord.offset > _bytes.size() || kRecord.length > _bytes.size() - kRecord.offset)
+  {
+    throw std::invalid_argument("Damaged shared archive: " + _path);
+  }
+
+  return {reinterpret_cast<const char *>(_bytes.data() + kRecord.offset), kRecord.length};
+}
+
+CppDuke::Symbol CppDuke::SharedArchive::_Symbol(const uint32_t idx) const
+{
+  Symbol symbol = idx < _symbolCount ? _symbols[idx].load(std::memory_order_acquire) : nullptr;
+  if (symbol == nullptr)
+  {
+    symbol = SymbolTable::Intern(_Text(idx));
+    _symbols[idx].store(symbol, std::memory_order_release);
+  }
+
+  return symbol;
+}
+
+CppDuke::Klass CppDuke::SharedArchive::_Materialize(const KlassRecord &record) const
+{
+  const std::span<const uint8_t> kFile = _Section(record.file, record.fileSize, 1);
+  const auto *kEntries = reinterpret_cast<const EntryRecord *>(
+      _Section(record.entries, record.poolSize, sizeof(EntryRecord)).data());
+  const std::size_t kMembers = record.fields + record.methods;
+  const auto *kMemberRecords = reinterpret_cast<const MemberRecord *>(
+      _Section(record.members, kMembers, sizeof(MemberRecord)).data());
+  const auto *kAttributes = reinterpret_cast<const AttributeRecord *>(
+      _Section(record.attributes, record.attributeCount, sizeof(AttributeRecord)).data());
+
+  // Sized to fit everything below and what Klass adds per method, so one
+  // chunk is all it takes.
+  Arena arena(record.poolSize * sizeof(ConstantPool::Pool::Entry)
+              + kMembers * sizeof(ConstantPool::CommonRef)
+              + record.attributeCount * (sizeof(ConstantPool::CommonAttribute) + sizeof(ConstantPool::CodeAttribute))
+              + record.methods * 2 * sizeof(void *)
+              + 64);
+
+  ConstantPool::Pool::Entry *entries = arena.Allocate<ConstantPool::Pool::Entry>(record.poolSize);
+  for (uint16_t i = 0; i < record.poolSize; i++)
+  {
+    const EntryRecord &kRecord = kEntries[i];
+    ConstantPool::Pool::Entry &entry = entries[i];
+    entry = ConstantPool::Pool::Entry{{}, kRecord.tag};
+    switch (kRecord.tag)
+    {
+      case ConstantPool::UTF_8:
+        entry.utf8 = _Symbol(static_cast<uint32_t>(kRecord.bits));
+        break;
+      case ConstantPool::INTEGER:
+        entry.i = static_cast<int32_t>(kRecord.bits);
+        break;
+      case ConstantPool::FLOAT:
+      {
+        const auto kBits = static_cast<uint32_t>(kRecord.bits);
+        std::memcpy(&entry.f, &kBits, sizeof(kBits));
+        break;
+      }
+      case ConstantPool::LONG:
+      case ConstantPool::CONST_DOUBLE:
+        std::memcpy(&entry.l, &kRecord.bits, sizeof(kRecord.bits));
+        break;
+      case ConstantPool::EMPTY:
+        break;
+      default:
+        entry.ref = {static_cast<uint16_t>(kRecord.bits), static_cast<uint16_t>(kRecord.bits >> 16)};
+        break;
+    }
+  }
+  const ConstantPool::Pool kPool{{entries, record.poolSize}};
+
+  std::size_t next = 0;
+  auto attributes = [&](const std::size_t count) -> std::span<const ConstantPool::CommonAttribute>
+  {
+    if (count > record.attributeCount - next)
+    {
+      throw std::invalid_argument("Damaged shared archive: " + _path);
+    }
+
+    ConstantPool::CommonAttribute *made = arena.Allocate<ConstantPool::CommonAttribute>(count);
+    for (std::size_t i = 0; i < count; i++)
+    {
+      const AttributeRecord &kRecord = kAttributes[next++];
+      const ConstantPool::CodeAttribute *code = nullptr;
+      if (kRecord.code != kNoCode)
+      {
+        if (kRecord.code > kFile.size() || kRecord.codeSize > kFile.size() - kRecord.code)
+        {
+          throw std::invalid_argument("Damaged shared archive: " + _path);
+        }
+        code = arena.New<ConstantPool::CodeAttribute>(kFile.subspan(kRecord.code, kRecord.codeSize));
+      }
+
+      std::construct_at(&made[i],
+                        kRecord.nameIndex,
+                        kRecord.length,
+                        kPool.Utf8(kRecord.nameIndex),
+                        code);
+    }
+
+    return {made, count};
+  };
+
+  const std::span<const ConstantPool::CommonAttribute> kKlassAttributes = attributes(record.klassAttributes);
+  ConstantPool::CommonRef *members = arena.Allocate<ConstantPool::CommonRef>(kMembers);
+  for (std::size_t i = 0; i < kMembers; i++)
+  {
+    const MemberRecord &kRecord = kMemberRecords[i];
+    std::construct_at(&members[i],
+                      kRecord.flags,
+                      kRecord.name,
+                      kRecord.descriptor,
+                      attributes(kRecord.attributes));
+  }
+
+  return Klass{_Symbol(record.name),
+               ClassFile{std::vector<uint8_t>{}},
+               std::move(arena),
+               kPool,
+               {members, record.fields},
+               {members + record.fields, record.methods},
+               kKlassAttributes};
+}
+
+std::size_t CppDuke::SharedArchive::Dump(const KlassRegistry &klasses, const std::string &path)
+{
+  Writer writer;
+  Header header{};
+  writer.Append(&header, sizeof(header));
+
+  std::unordered_map<Symbol, uint32_t> indices;
+  std::vector<Symbol> symbols;
+  auto index = [&](const Symbol symbol)
+  {
+    auto [itr, kAdded] = indices.try_emplace(symbol, static_cast<uint32_t>(symbols.size()));
+    if (kAdded)
+    {
+      symbols.push_back(symbol);
+    }
+    return itr->second;
+  };
+
+  std::vector<KlassRecord> records;
+  for (const Klass *klass: klasses.Klasses())
+  {
+    // Classes taken from an archive have no class file to keep.
+    const std::span<const uint8_t> kFile = klass->Bytes();
+    if (kFile.empty())
+    {
+      continue;
+    }
+
+    KlassRecord record{};
+    record.name = index(klass->Name());
+    record.checksum = Crc32(kFile);
+    record.file = writer.Append(kFile.data(), kFile.size());
+    record.fileSize = kFile.size();
+
+    std::vector<EntryRecord> entries;
+    for (const ConstantPool::Pool::Entry &kEntry: klass->Pool().Entries())
+    {
+      EntryRecord entry{0, kEntry.tag, {}};
+      switch (kEntry.tag)
+      {
+        case ConstantPool::UTF_8:
+          entry.bits = index(kEntry.utf8);
+          break;
+        case ConstantPool::INTEGER:
+          entry.bits = static_cast<uint32_t>(kEntry.i);
+          break;
+        case ConstantPool::FLOAT:
+        {
+          uint32_t bits;
+          std::memcpy(&bits, &kEntry.f, sizeof(bits));
+          entry.bits = bits;
+          break;
+        }
+        case ConstantPool::LONG:
+        case ConstantPool::CONST_DOUBLE:
+          std::memcpy(&entry.bits, &kEntry.l, sizeof(entry.bits));
+          break;
+        case ConstantPool::EMPTY:
+          break;
+        default:
+          entry.bits = kEntry.ref.first | static_cast<uint32_t>(kEntry.ref.second) << 16;
+          break;
+      }
+      entries.push_back(entry);
+    }
+    record.poolSize = static_cast<uint16_t>(entries.size());
+    record.entries = writer.Append(entries);
+
+    std::vector<AttributeRecord> attributes;
+    auto add = [&](const std::span<const ConstantPool::CommonAttribute> kAttributes)
+    {
+      for (const ConstantPool::CommonAttribute &kAttribute: kAttributes)
+      {
+        AttributeRecord attribute{kAttribute.NameIndex(), 0, kAttribute.Length(), kNoCode, 0};
+        if (const ConstantPool::CodeAttribute *code = kAttribute.GetCodeAttribute())
+        {
+          attribute.code = static_cast<uint32_t>(code->Body().data() - kFile.data());
+          attribute.codeSize = static_cast<uint32_t>(code->Body().size());
+        }
+        attributes.push_back(attribute);
+      }
+    };
+
+    add(klass->Attributes());
+    record.klassAttributes = static_cast<uint16_t>(klass->Attributes().size());
+
+    std::vector<MemberRecord> members;
+    for (const std::span<const ConstantPool::CommonRef> kMembers: {klass->Fields(), klass->Methods()})
+    {
+      for (const ConstantPool::CommonRef &kMember: kMembers)
+      {
+        members.push_back(MemberRecord{kMember.Flags(),
+                                       kMember.NameIndex(),
+                                       kMember.DescIndex(),
+                                       static_cast<uint16_t>(kMember.GetChildAttributes().size())});
+        add(kMember.GetChildAttributes());
+      }
+    }
+    record.fields = static_cast<uint16_t>(klass->Fields().size());
+    record.methods = static_cast<uint16_t>(klass->Methods().size());
+    record.members = writer.Append(members);
+    record.attributes = writer.Append(attributes);
+    record.attributeCount = attributes.size();
+
+    records.push_back(record);
+  }
+
+  std::vector<SymbolRecord> table;
+  table.reserve(symbols.size());
+  for (const Symbol symbol: symbols)
+  {
+    table.push_back(SymbolRecord{writer.Append(symbol->data(), symbol->size()),
+                                 static_cast<uint32_t>(symbol->size()),
+                                 0});
+  }
+
+  std::memcpy(header.magic, kMagic, sizeof(kMagic));
+  header.version = kVersion;
+  header.byteOrder = kByteOrder;
+  header.symbols = writer.Append(table);
+  header.symbolCount = static_cast<uint32_t>(table.size());
+  header.klasses = writer.Append(records);
+  header.klassCount = static_cast<uint32_t>(records.size());
+  header.size = writer.Bytes().size();
+  std::memcpy(writer.Bytes().data(), &header, sizeof(header));
+
+  // Written aside and renamed over path, a run mapping the old archive never
+  // sees a half written one.
+  const std::string kTemporary = path + ".tmp";
+  {
+    std::ofstream out{kTemporary, std::ios::binary | std::ios::trunc};
+    out.write(reinterpret_cast<const char *>(writer.Bytes().data()), static_cast<std::streamsize>(writer.Bytes().size()));
+    if (!out.flush())
+    {
+      throw std::invalid_argument("Cannot write shared archive: " + path);
+    }
+  }
+
+  std::error_code error;
+  std::filesystem::rename(kTemporary, path, error);
+  if (error)
+  {
+    throw std::invalid_argument("Cannot write shared archive: " + path);
+  }
+
+  return records.size();
+}
+
+std::optional<CppDuke::Klass> CppDuke::SharedArchive::Load(const Symbol name, const ClassPath &classPath) const
+{
+  auto itr = _klasses.find(*name);
+  if (itr == std::end(_klasses))
+  {
+    return std::nullopt;
+  }
+
+  const KlassRecord &kRecord = *itr->second;
+  if (classPath.Checksum(*name) != kRecord.checksum)
+  {
+    _stale++;
+    return std::nullopt;
+  }
+
+  _shared++;
+  return _Materialize(kRecord);
+}
+
+bool CppDuke::SharedArchive::Contains(const std::string &name) const
+{
+  return _klasses.contains(name);
+}
+
+std::size_t CppDuke::SharedArchive::Size() const
+{
+  return _klasses.size();
+}
+
+CppDuke::SharedArchive::Stats CppDuke::SharedArchive::Report() const
+{
+  return Stats{_shared, _stale};
+}
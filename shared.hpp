@@ -0,0 +1,89 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+#include "classfile.hpp"
+#include "classpath.hpp"
+#include "klass.hpp"
+#include "registry.hpp"
+
+namespace CppDuke
+{
+// Parsed classes saved to one file by -Xshare:dump and mapped back by
+// -Xshare:on, so a later run does not read or parse their class files.
+//
+// The archive holds offsets only, never addresses, and is mapped anywhere.
+// Symbols are stored as text and interned on first use, constant pools,
+// members and attributes as fixed size records referring to them by index,
+// and Code attributes stay in the copy of the class file inside the archive,
+// where the classes made from it point straight into the mapping. Member
+// indexes and signatures are keyed by symbol address, so they are rebuilt
+// when a class is taken out. Decoded methods are not archived, they hold
+// addresses of dispatch handlers and are made on first invocation anyway.
+//
+// Every class carries the CRC-32 of its class file. It is only handed out
+// while the class file on the class path still has the same one.
+class SharedArchive
+{
+public:
+  struct Stats
+  {
+    // Taken from the archive, and left out because the class file changed.
+    uint64_t shared, stale;
+  };
+
+private:
+  struct KlassRecord;
+
+  std::string _path;
+  // The whole archive, mapped read only. Must outlive the classes taken from
+  // it.
+  ClassFile _file;
+  std::span<const uint8_t> _bytes;
+  std::unordered_map<std::string_view, const KlassRecord *> _klasses;
+  // Interned lazily, a class only interns the symbols it uses. Interning
+  // twice gives the same symbol, so racing threads do no harm.
+  std::size_t _symbolCount;
+  const uint8_t *_symbolTable;
+  std::unique_ptr<std::atomic<Symbol>[]> _symbols;
+
+  mutable std::atomic<uint64_t> _shared, _stale;
+
+  std::string_view _Text(uint32_t idx) const;
+  Symbol _Symbol(uint32_t idx) const;
+  // Throws std::invalid_argument if count records of size bytes at offset do
+  // not fit in the archive.
+  std::span<const uint8_t> _Section(uint64_t offset, uint64_t count, std::size_t size) const;
+  Klass _Materialize(const KlassRecord &record) const;
+
+public:
+  // Maps the archive at path. Throws std::invalid_argument if it cannot be
+  // read or was not written by this version.
+  explicit SharedArchive(const std::string &path);
+  SharedArchive(const SharedArchive &) = delete;
+  SharedArchive &operator=(const SharedArchive &) = delete;
+
+  // Writes every class in klasses that was parsed from a class file to path
+  // and returns how many. Throws std::invalid_argument if path cannot be
+  // written.
+  static std::size_t Dump(const KlassRegistry &klasses, const std::string &path);
+
+  // The class named name as it was archived, if it was and classPath holds
+  // the same class file. None otherwise, it is then loaded from the class
+  // path as usual. Thread safe.
+  std::optional<Klass> Load(Symbol name, const ClassPath &classPath) const;
+
+  // Whether name was archived, changed or not.
+  bool Contains(const std::string &name) const;
+
+  // Classes in the archive.
+  std::size_t Size() const;
+  Stats Report() const;
+};
+}
@@ -0,0 +1,145 @@
+#include "signature.hpp"
+
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <unordered_map>
+
+namespace
+{
+using CppDuke::MethodSignature;
+
+// Reads one field type starting at pos and moves pos past it.
+MethodSignature::Kind ParseType(const std::string &desc, std::size_t &pos)
+{
+  if (pos >= desc.size())
+  {
+    throw std::invalid_argument("Truncated descriptor: " + desc);
+  }
+
+  const char kC = desc[pos++];
+  switch (kC)
+  {
+    case 'Z':
+    case 'B':
+    case 'C':
+    case 'S':
+    case 'I':
+    case 'J':
+    case 'F':
+    case 'D':
+    case 'V':
+      return static_cast<MethodSignature::Kind>(kC);
+
+    case 'L':
+      pos = desc.find(';', pos);
+      if (pos == std::string::npos)
+      {
+        throw std::invalid_argument("Unterminated class name in descriptor: " + desc);
+      }
+      pos++;
+      return MethodSignature::REFERENCE;
+
+    case '[':
+      while (pos < desc.size() && desc[pos] == '[')
+      {
+        pos++;
+      }
+      if (ParseType(desc, pos) == MethodSignature::VOID)
+      {
+        throw std::invalid_argument("Array of void in descriptor: " + desc);
+      }
+      return MethodSignature::REFERENCE;
+
+    default:
+      throw std::invalid_argument("Invalid descriptor: " + desc);
+  }
+}
+}
+
+CppDuke::MethodSignature::MethodSignature(const std::string &descriptor)
+    : _descriptor(descriptor),
+      _slots(0),
+      _return(VOID)
+{
+  if (descriptor.empty() || descriptor[0] != '(')
+  {
+    throw std::invalid_argument("Invalid descriptor: " + descriptor);
+  }
+
+  std::size_t pos = 1;
+  while (pos < descriptor.size() && descriptor[pos] != ')')
+  {
+    const Kind kKind = ParseType(descriptor, pos);
+    if (kKind == VOID)
+    {
+      throw std::invalid_argument("Void parameter in descriptor: " + descriptor);
+    }
+
+    _params.push_back(kKind);
+    _offsets.push_back(_slots);
+    _slots += IsWide(kKind) ? 2 : 1;
+  }
+
+  if (pos >= descriptor.size())
+  {
+    throw std::invalid_argument("Unterminated parameters in descriptor: " + descriptor);
+  }
+
+  pos++;
+  _return = ParseType(descriptor, pos);
+  if (pos != descriptor.size())
+  {
+    throw std::invalid_argument("Trailing characters in descriptor: " + descriptor);
+  }
+}
+
+const CppDuke::MethodSignature &CppDuke::MethodSignature::Intern(const Symbol descriptor)
+{
+  static std::mutex lock;
+  static std::unordered_map<Symbol, std::unique_ptr<MethodSignature>> signatures;
+
+  std::lock_guard<std::mutex> guard{lock};
+  std::unique_ptr<MethodSignature> &signature = signatures[descriptor];
+  if (!signature)
+  {
+    signature = std::make_unique<MethodSignature>(*descriptor);
+  }
+
+  return *signature;
+}
+
+const std::string &CppDuke::MethodSignature::Descriptor() const
+{
+  return _descriptor;
+}
+
+const std::vector<CppDuke::MethodSignature::Kind> &CppDuke::MethodSignature::Params() const
+{
+  return _params;
+}
+
+const std::vector<uint16_t> &CppDuke::MethodSignature::Offsets() const
+{
+  return _offsets;
+}
+
+uint16_t CppDuke::MethodSignature::Slots() const
+{
+  return _slots;
+}
+
+CppDuke::MethodSignature::Kind CppDuke::MethodSignature::Return() const
+{
+  return _return;
+}
+
+bool CppDuke::MethodSignature::HasWideParams() const
+{
+  return _slots != _params.size();
+}
+
+bool CppDuke::MethodSignature::IsWide(const Kind kind)
+{
+  return kind == LONG || kind == DOUBLE;
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "symbol.hpp"
+
+namespace CppDuke
+{
+// A method descriptor such as (IJLjava/lang/String;)V, parsed once. Equal
+// descriptors share one instance across every loaded class.
+class MethodSignature
+{
+public:
+  // Named after the descriptor letters, arrays are references too.
+  typedef enum : char
+  {
+    VOID = 'V',
+    BOOLEAN = 'Z',
+    BYTE = 'B',
+    CHAR = 'C',
+    SHORT = 'S',
+    INT = 'I',
+    LONG = 'J',
+    FLOAT = 'F',
+    DOUBLE = 'D',
+    REFERENCE = 'L',
+  } Kind;
+
+private:
+  std::string _descriptor;
+  std::vector<Kind> _params;
+  // Local slot of each parameter, longs and doubles take two.
+  std::vector<uint16_t> _offsets;
+  uint16_t _slots;
+  Kind _return;
+
+public:
+  explicit MethodSignature(const std::string &descriptor);
+
+  // The shared instance for descriptor, parsed on first use. Thread safe.
+  static const MethodSignature &Intern(Symbol descriptor);
+
+  const std::string &Descriptor() const;
+  const std::vector<Kind> &Params() const;
+  const std::vector<uint16_t> &Offsets() const;
+
+  // Local slots taken by the parameters, not counting a receiver.
+  uint16_t Slots() const;
+  Kind Return() const;
+
+  // True if some parameter takes two local slots, so arguments cannot be
+  // used as locals exactly as they were pushed.
+  bool HasWideParams() const;
+  static bool IsWide(Kind kind);
+};
+}
@@ -0,0 +1,41 @@
+#include "symbol.hpp"
+
+#include <functional>
+#include <mutex>
+#include <unordered_set>
+
+namespace
+{
+// Lets the table be probed with a string_view without making a string.
+struct Hash
+{
+  using is_transparent = void;
+
+  std::size_t operator()(const std::string_view s) const
+  {
+    return std::hash<std::string_view>{}(s);
+  }
+};
+
+std::mutex lock;
+// Nodes never move, pointers to the strings stay valid as the table grows.
+std::unordered_set<std::string, Hash, std::equal_to<>> symbols;
+}
+
+CppDuke::Symbol CppDuke::SymbolTable::Intern(const std::string_view s)
+{
+  std::lock_guard<std::mutex> guard{lock};
+  auto itr = symbols.find(s);
+  if (itr == std::end(symbols))
+  {
+    itr = symbols.emplace(s).first;
+  }
+
+  return &*itr;
+}
+
+std::size_t CppDuke::SymbolTable::Size()
+{
+  std::lock_guard<std::mutex> guard{lock};
+  return symbols.size();
+}
@@ -0,0 +1,20 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+
+namespace CppDuke
+{
+// Interned text from class files: names, descriptors and string constants.
+// Equal text always interns to the same object, so symbols compare by
+// address and are never freed.
+typedef const std::string *Symbol;
+
+class SymbolTable
+{
+public:
+  // Thread safe.
+  static Symbol Intern(std::string_view s);
+  static std::size_t Size();
+};
+}
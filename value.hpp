@@ -0,0 +1,257 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "monitor.hpp"
+
+namespace CppDuke
+{
+class Klass;
+}
+
+namespace CppDuke::VirtualMachine
+{
+class Object;
+
+// A single operand stack or local variable slot. The payload is always 64 bits
+// wide and the tag sits alongside it, so moving a value around is a plain copy
+// with no allocation and no RTTI.
+class Value
+{
+public:
+  typedef enum : uint8_t
+  {
+    EMPTY = 0,
+    INT,
+    LONG,
+    FLOAT,
+    DOUBLE,
+    REFERENCE,
+  } Type;
+
+private:
+  union
+  {
+    int32_t _i;
+    int64_t _l;
+    float _f;
+    double _d;
+    Object *_ref;
+  };
+  Type _type;
+
+public:
+  constexpr Value() : _l(0), _type(EMPTY)
+  {}
+
+  template<typename _Ty>
+  static constexpr Value From(const _Ty v)
+  {
+    Value val;
+    if constexpr (std::is_same_v<_Ty, int64_t>)
+    {
+      val._l = v;
+      val._type = LONG;
+    } else if constexpr (std::is_same_v<_Ty, float>)
+    {
+      val._f = v;
+      val._type = FLOAT;
+    } else if constexpr (std::is_same_v<_Ty, double>)
+    {
+      val._d = v;
+      val._type = DOUBLE;
+    } else if constexpr (std::is_pointer_v<_Ty> || std::is_null_pointer_v<_Ty>)
+    {
+      val._ref = v;
+      val._type = REFERENCE;
+    } else
+    {
+      static_assert(std::is_integral_v<_Ty> && sizeof(_Ty) <= sizeof(int32_t));
+      val._i = v;
+      val._type = INT;
+    }
+
+    return val;
+  }
+
+  template<typename _Ty>
+  constexpr _Ty As() const
+  {
+    if constexpr (std::is_same_v<_Ty, int64_t>)
+    {
+      return _l;
+    } else if constexpr (std::is_same_v<_Ty, float>)
+    {
+      return _f;
+    } else if constexpr (std::is_same_v<_Ty, double>)
+    {
+      return _d;
+    } else if constexpr (std::is_pointer_v<_Ty>)
+    {
+      return static_cast<_Ty>(_ref);
+    } else
+    {
+      static_assert(std::is_same_v<_Ty, int32_t>);
+      return _i;
+    }
+  }
+
+  constexpr Type Tag() const
+  {
+    return _type;
+  }
+
+  // True if the value holds what As<_Ty>() reads. Integral types narrower
+  // than int are held as INT.
+  template<typename _Ty>
+  constexpr bool Is() const
+  {
+    if constexpr (std::is_same_v<_Ty, int64_t>)
+    {
+      return _type == LONG;
+    } else if constexpr (std::is_same_v<_Ty, float>)
+    {
+      return _type == FLOAT;
+    } else if constexpr (std::is_same_v<_Ty, double>)
+    {
+      return _type == DOUBLE;
+    } else if constexpr (std::is_pointer_v<_Ty>)
+    {
+      return _type == REFERENCE;
+    } else
+    {
+      return _type == INT;
+    }
+  }
+
+  // Long and double, the values the spec counts as two stack slots. They
+  // take one here like any other, POP2 and the DUP2 family check for them.
+  constexpr bool IsWide() const
+  {
+    return _type == LONG || _type == DOUBLE;
+  }
+
+  constexpr bool IsNull() const
+  {
+    return _type == REFERENCE && _ref == nullptr;
+  }
+};
+
+// Heap objects referenced by REFERENCE values. They are owned by the
+// interpreter that allocated them.
+class Object
+{
+  const Klass *_klass;
+  std::vector<Value> _fields;
+  Lock _lock;
+
+public:
+  explicit Object(const Klass *klass, std::vector<Value> fields = {}) : _klass(klass), _fields(std::move(fields))
+  {}
+
+  virtual ~Object() = default;
+
+  const Klass *GetKlass() const
+  {
+    return _klass;
+  }
+
+  // What MONITORENTER, MONITOREXIT and synchronized methods lock.
+  Lock &Monitor()
+  {
+    return _lock;
+  }
+
+  // Instance fields by the slot the class layout gives them.
+  Value &Field(std::size_t slot)
+  {
+    return _fields[slot];
+  }
+};
+
+class Array : public Object
+{
+  std::vector<Value> _elements;
+
+public:
+  explicit Array(std::size_t length, Value init) : Object(nullptr), _elements(length, init)
+  {}
+
+  Value &operator[](std::size_t pos)
+  {
+    return _elements[pos];
+  }
+
+  std::size_t Length() const
+  {
+    return _elements.size();
+  }
+};
+
+class String : public Object
+{
+  std::string _data;
+
+public:
+  explicit String(std::string data) : Object(nullptr), _data(std::move(data))
+  {}
+
+  const std::string &Data() const
+  {
+    return _data;
+  }
+};
+
+// A java.lang.Thread. Once started, the run() method of its target runs on
+// a thread of its own, an OS thread or a green one.
+class Thread : public Object
+{
+  Object *_target;
+  std::atomic<bool> _started, _done;
+
+public:
+  Thread() : Object(nullptr), _target(nullptr), _started(false), _done(false)
+  {}
+
+  Object *Target() const
+  {
+    return _target;
+  }
+
+  void SetTarget(Object *target)
+  {
+    _target = target;
+  }
+
+  // False if it was started before.
+  bool Start()
+  {
+    return !_started.exchange(true);
+  }
+
+  void Finish()
+  {
+    _done.store(true, std::memory_order_release);
+    _done.notify_all();
+  }
+
+  // True if Join() would return at once.
+  bool Finished() const
+  {
+    return !_started.load() || _done.load(std::memory_order_acquire);
+  }
+
+  // Returns at once if it was never started.
+  void Join() const
+  {
+    if (_started.load())
+    {
+      _done.wait(false, std::memory_order_acquire);
+    }
+  }
+};
+}
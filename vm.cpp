@@ -1,94 +1,171 @@
 #include "vm.hpp"
 
-#include <iostream>
-
-#define TWO_BYTE_CONSTRUCT(code, i) ((((signed char)(code[(i) + 1])) << 8) + code[(i) + 2])
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <mutex>
+#include <stdexcept>
+#include <system_error>
+
+#if defined(__GNUC__) && !defined(CPPDUKE_SWITCH_DISPATCH)
+// Each handler jumps straight to the next one through the address stored in
+// the decoded instruction. Define CPPDUKE_SWITCH_DISPATCH to use the portable
+// switch based loop instead.
+#define CPPDUKE_THREADED_DISPATCH
+#endif
+
+CppDuke::VirtualMachine::Frame::Frame(const DecodedMethod &method, Value *locals)
+    : _method(&method),
+      _pc(method.Entry()),
+      _locals(locals),
+      _sp(locals + method.MaxLocals() + 1)
+{
+}
 
-CppDuke::VirtualMachine::Frame::Frame(const uint16_t locals)
+const CppDuke::VirtualMachine::DecodedMethod &CppDuke::VirtualMachine::Frame::Method() const
 {
-  _locals.resize(locals + 1);
+  return *_method;
 }
 
-std::any CppDuke::VirtualMachine::Frame::At(const int pos) const
+const CppDuke::Klass &CppDuke::VirtualMachine::Frame::Owner() const
 {
-  return _locals[pos];
+  return _method->Owner();
 }
 
-std::any CppDuke::VirtualMachine::Frame::Top() const
+CppDuke::VirtualMachine::Value *CppDuke::VirtualMachine::Frame::Locals() const
 {
-  return _stack.top();
+  return _locals;
 }
 
-std::any CppDuke::VirtualMachine::Frame::Pop()
+const CppDuke::VirtualMachine::Instruction *CppDuke::VirtualMachine::Frame::Pc() const
 {
-  std::any top = Top();
-  _stack.pop();
+  return _pc;
+}
 
-  return top;
+CppDuke::VirtualMachine::Value *CppDuke::VirtualMachine::Frame::Sp() const
+{
+  return _sp;
 }
 
-void CppDuke::VirtualMachine::Frame::Push(const std::any &item)
+void CppDuke::VirtualMachine::Frame::Save(const Instruction *pc, Value *sp)
 {
-  _stack.emplace(item);
+  _pc = pc;
+  _sp = sp;
 }
 
-void CppDuke::VirtualMachine::Frame::Set(const int pos, const std::any val)
+CppDuke::VirtualMachine::Interpreter::Interpreter(KlassRegistry &klasses,
+                                                  const KlassLoader &loader,
+                                                  const std::string &kMain,
+                                                  const std::size_t stackSize)
+    : _main(kMain),
+      _klasses(klasses),
+      _loader(loader),
+      _stack(std::max<std::size_t>(stackSize / sizeof(Value), 1)),
+      _ownProgram(std::make_unique<Program>()),
+      _program(*_ownProgram),
+      _stats(false),
+      _trace(false),
+      _checked(false),
+      _safepoints(false),
+      _greenThreads(false),
+      _carriers(0),
+      _executed(0),
+      _safepoint(false),
+      _ngrams(0),
+      _history(0),
+      _self(Lock::NewOwner()),
+      _green(false),
+      _execute(nullptr)
 {
-  if (!val.has_value())
-  {
-    throw std::invalid_argument("Value is empty for position " + std::to_string(pos));
-  }
+  // A frame never accounts for less than a slot, even if it has no locals
+  // and no operands, so this is enough for the deepest possible stack.
+  _frames.reserve(_stack.size());
+}
 
-  _locals[pos] = val;
+CppDuke::VirtualMachine::Interpreter::Interpreter(const Interpreter &starter, Program &program)
+    : _main(starter._main),
+      _klasses(starter._klasses),
+      _loader(starter._loader),
+      _stack(program.scheduler ? std::min(starter._stack.size(), kGreenStackSize / sizeof(Value))
+                               : starter._stack.size()),
+      _program(program),
+      _stats(starter._stats),
+      _trace(starter._trace),
+      _checked(starter._checked),
+      _safepoints(starter._safepoints),
+      _greenThreads(false),
+      _carriers(0),
+      _executed(0),
+      _safepoint(false),
+      _ngrams(starter._ngrams),
+      _history(0),
+      _self(Lock::NewOwner()),
+      _green(program.scheduler != nullptr),
+      _execute(starter._execute)
+{
+  _frames.reserve(_stack.size());
 }
 
-std::size_t CppDuke::VirtualMachine::Frame::Size() const
+template<typename _Ty, typename... _Args>
+_Ty *CppDuke::VirtualMachine::Interpreter::_Allocate(_Args &&... args)
 {
-  return _stack.size();
+  auto object = std::make_unique<_Ty>(std::forward<_Args>(args)...);
+  _Ty *raw = object.get();
+  _heap.emplace_back(std::move(object));
+
+  return raw;
 }
 
-CppDuke::VirtualMachine::Interpreter::Interpreter(const std::vector<Klass> &klasses,
-                                                  const std::string &kMain)
-    : _main(kMain)
+CppDuke::VirtualMachine::String *CppDuke::VirtualMachine::Interpreter::_Intern(const Symbol s)
 {
-  for (const Klass &k: klasses)
+  // String literals are interned, the same constant always yields the same
+  // object, whichever thread loads it.
+  std::lock_guard<std::mutex> guard{_program.lock};
+  auto itr = _program.strings.find(s);
+  if (itr != std::end(_program.strings))
   {
-    _klasses.emplace(std::pair{k.Name(), k});
+    return itr->second;
   }
+
+  String *str = _Allocate<String>(*s);
+  _program.strings.emplace(s, str);
+  return str;
 }
 
 template<typename _Ty>
-_Ty CppDuke::VirtualMachine::Interpreter::_Bitwise(const uint8_t& kOpcode)
+_Ty CppDuke::VirtualMachine::Interpreter::_Bitwise(const uint8_t &kOpcode, const _Ty v1, const Value v2)
 {
-  _Ty v1 = std::any_cast<_Ty>(_frames.top().Pop());
-  std::any v2 = _frames.top().Pop();
+  // The shift distance is always an int, only the low 5 (or 6) bits are used.
+  constexpr int32_t kShiftMask = sizeof(_Ty) * 8 - 1;
 
   _Ty res{};
   switch (kOpcode)
   {
     case ISHL:
     case LSHL:
-      res = v1 << std::any_cast<int>(v2);
+      res = v1 << (v2.As<int32_t>() & kShiftMask);
       break;
 
     case ISHR:
     case LSHR:
-      res = v1 >> std::any_cast<int>(v2);
+      res = v1 >> (v2.As<int32_t>() & kShiftMask);
       break;
 
     case IAND:
     case LAND:
-      res = v1 & std::any_cast<_Ty>(v2);
+      res = v1 & v2.As<_Ty>();
       break;
 
     case IOR:
     case LOR:
-      res = v1 | std::any_cast<_Ty>(v2);
+      res = v1 | v2.As<_Ty>();
       break;
 
     case IXOR:
     case LXOR:
-      res = v1 ^ std::any_cast<_Ty>(v2);
+      res = v1 ^ v2.As<_Ty>();
       break;
 
     default:
@@ -99,20 +176,9 @@ _Ty CppDuke::VirtualMachine::Interpreter::_Bitwise(const uint8_t& kOpcode)
   return res;
 }
 
-bool CppDuke::VirtualMachine::Interpreter::_Cmp(const uint8_t &kOpcode)
+bool CppDuke::VirtualMachine::Interpreter::_Cmp(const uint8_t &kOpcode, const int32_t v1, const int32_t v2)
 {
-  Frame &frame = _frames.top();
-  int v1 = std::any_cast<int>(frame.Pop());
-  int v2 = 0;
-
-  if (kOpcode >= IF_ICMPEQ && kOpcode <= IF_ICMPLE)
-  {
-    v2 = std::any_cast<int>(frame.Pop());
-  } else if (kOpcode >= IF_ICMPEQ && kOpcode <= IF_ICMPLE)
-  {
-    std::swap(v1, v2);
-  }
-
+  // IF<cond> is handed a zero v2, IF_ICMP<cond> the topmost value.
   switch (kOpcode)
   {
     case IFEQ:
@@ -139,11 +205,8 @@ bool CppDuke::VirtualMachine::Interpreter::_Cmp(const uint8_t &kOpcode)
 }
 
 template<typename _Ty>
-_Ty CppDuke::VirtualMachine::Interpreter::_Math(const uint8_t &opcode)
+_Ty CppDuke::VirtualMachine::Interpreter::_Math(const uint8_t &opcode, const _Ty v1, const _Ty v2)
 {
-  _Ty v1 = std::any_cast<_Ty>(_frames.top().Pop());
-  _Ty v2 = std::any_cast<_Ty>(_frames.top().Pop());
-
   switch (opcode)
   {
     case IADD:
@@ -156,7 +219,7 @@ _Ty CppDuke::VirtualMachine::Interpreter::_Math(const uint8_t &opcode)
     case LSUB:
     case FSUB:
     case DSUB:
-      return v2 - v1;
+      return v1 - v2;
 
     case IMUL:
     case LMUL:
@@ -168,545 +231,1508 @@ _Ty CppDuke::VirtualMachine::Interpreter::_Math(const uint8_t &opcode)
     case LDIV:
     case FDIV:
     case DDIV:
-      return v2 / v1;
+      return v1 / v2;
 
     default:
       throw std::invalid_argument("Cannot perform math op for opcode");
   }
 }
 
-void CppDuke::VirtualMachine::Interpreter::_ExecOpcode(const std::vector<uint8_t> &kByteCode,
-                                                       int &i,
-                                                       std::any &rval)
-{
-  const Klass &klass = _trace.top();
-  const uint8_t kOpcode = kByteCode[i];
-  printf("%d: %x\n", i, kOpcode);
-
-  Frame &frame = _frames.top();
-  switch (kOpcode)
-  {
-    case NOP:
-      break;
-
-    case ACONST_NULL:
-      frame.Push(nullptr);
-      break;
-
-    case ICONST_M1:
-    case ICONST_0:
-    case ICONST_1:
-    case ICONST_2:
-    case ICONST_3:
-    case ICONST_4:
-    case ICONST_5:
-      frame.Push(kOpcode - ICONST_0);
-      break;
-
-    case LCONST_0:
-    case LCONST_1:
-      frame.Push(kOpcode - LCONST_0);
-      break;
-
-    case FCONST_0:
-    case FCONST_1:
-    case FCONST_2:
-      frame.Push(kOpcode - FCONST_0);
-      break;
-
-    case DCONST_0:
-    case DCONST_1:
-      frame.Push(kOpcode - DCONST_0);
-      break;
-
-    case SIPUSH:
-      frame.Push(TWO_BYTE_CONSTRUCT(kByteCode, i));
-      i += 2;
-      break;
+// Every opcode the decoder can produce and that has a handler below.
+#define HANDLERS(X) \
+  X(NOP) X(ACONST_NULL) X(SIPUSH) X(LCONST_0) X(FCONST_0) X(DCONST_0) X(LDC) \
+  X(ILOAD) X(IALOAD) X(ISTORE) X(IASTORE) \
+  X(POP) X(POP2) X(DUP) X(DUP_X1) X(DUP_X2) X(DUP2) X(DUP2_X1) X(DUP2_X2) X(SWAP) \
+  X(IADD) X(LADD) X(FADD) X(DADD) X(ISUB) X(LSUB) X(FSUB) X(DSUB) \
+  X(IMUL) X(LMUL) X(FMUL) X(DMUL) X(IDIV) X(LDIV) X(FDIV) X(DDIV) \
+  X(ISHL) X(LSHL) X(ISHR) X(LSHR) X(IAND) X(LAND) X(IOR) X(LOR) X(IXOR) X(LXOR) \
+  X(IINC) X(I2L) X(I2F) X(I2D) X(L2I) X(L2F) X(L2D) X(F2I) X(F2L) X(F2D) \
+  X(D2I) X(D2L) X(D2F) X(I2C) \
+  X(IFEQ) X(IFNEQ) X(IFLT) X(IFGE) X(IFGT) X(IFLE) \
+  X(IF_ICMPEQ) X(IF_ICMPNE) X(IF_ICMPLT) X(IF_ICMPGE) X(IF_ICMPGT) X(IF_ICMPLE) \
+  X(GOTO) X(IRETURN) X(RETURN) X(INVOKEVIRTUAL) X(INVOKESPECIAL) X(INVOKESTATIC) \
+  X(NEW) X(NEWARRAY) X(ARRAYLENGTH) X(MONITORENTER) X(MONITOREXIT) \
+  X(IFNULL) X(IFNONNULL) X(BREAKPOINT) X(IMPDEP1) X(IMPDEP2) \
+  X(ILOAD_ILOAD_IF_ICMPEQ) X(ILOAD_ILOAD_IF_ICMPNE) X(ILOAD_ILOAD_IF_ICMPLT) \
+  X(ILOAD_ILOAD_IF_ICMPGE) X(ILOAD_ILOAD_IF_ICMPGT) X(ILOAD_ILOAD_IF_ICMPLE) \
+  X(ILOAD_ICONST_IADD_ISTORE) X(ILOAD_ILOAD_IALOAD) X(IINC_GOTO) \
+  X(GETSTATIC) X(PUTSTATIC) X(GETFIELD) X(PUTFIELD) \
+  X(LDC_QUICK) X(NEW_QUICK) X(GETSTATIC_QUICK) X(PUTSTATIC_QUICK) X(GETFIELD_QUICK) X(PUTFIELD_QUICK) \
+  X(INVOKE_QUICK) X(INVOKE_SYNCHRONIZED) X(IRETURN_SYNCHRONIZED) X(RETURN_SYNCHRONIZED) \
+  X(NEW_THREAD) X(INVOKE_NATIVE)
+
+// Work done before every instruction, only in the variants that ask for it.
+#define ACCOUNT() \
+  do { \
+    if constexpr (_Policy::kProfile) \
+    { \
+      executed++; \
+      if (_ngrams) _RecordNgram(pc->opcode); \
+    } \
+    if constexpr (_Policy::kTrace) \
+    { \
+      printf("%u: %x\n", pc->bci, pc->opcode); \
+    } \
+  } while (0)
+
+#if defined(CPPDUKE_THREADED_DISPATCH)
+#define HANDLER(op) L_##op:
+#define DISPATCH() do { ACCOUNT(); goto *pc->handler; } while (0)
+#define REDISPATCH() goto *pc->handler
+#else
+#define HANDLER(op) case op:
+#define DISPATCH() goto dispatch
+#define REDISPATCH() goto redispatch
+#endif
+
+// Rewrites the current instruction into its quick form and runs it again,
+// without accounting for it twice.
+#define QUICKEN() \
+  do { \
+    Instruction &ins = const_cast<Instruction &>(*pc); \
+    _Quicken(*klass, ins, handlers); \
+    REDISPATCH(); \
+  } while (0)
+
+// Leaves the loop with the frames as they are.
+#define EXIT() \
+  do { \
+    if constexpr (_Policy::kProfile) \
+    { \
+      _executed += executed; \
+    } \
+    return; \
+  } while (0)
+
+// Stops at a requested safepoint with the frame saved as if it was about to
+// resume at target. Only backward jumps and calls poll, every loop has one.
+// A green thread leaves the loop from here when its quantum is up and
+// resumes at target.
+#define POLL(target) \
+  do { \
+    if constexpr (_Policy::kSafepoints) \
+    { \
+      if (_safepoint.load(std::memory_order_relaxed)) \
+      { \
+        *sp++ = tos; \
+        frame->Save(target, sp); \
+        if (_Safepoint()) \
+        { \
+          EXIT(); \
+        } \
+        --sp; \
+      } \
+    } \
+  } while (0)
+
+// Leaves the loop instead of blocking a green thread, the instruction runs
+// again once the thread is resumed.
+#define RETRY() \
+  do { \
+    *sp++ = tos; \
+    frame->Save(pc, sp); \
+    EXIT(); \
+  } while (0)
+
+#define JUMP(target) \
+  do { \
+    const Instruction *const kTarget = (target); \
+    if (kTarget <= pc) POLL(kTarget); \
+    pc = kTarget; \
+    DISPATCH(); \
+  } while (0)
+
+// Raises exception unless cond holds, in every variant. For the exceptions
+// any Java program may run into, null references and bad array indices.
+#define GUARD(cond, exception) \
+  do { \
+    if (!(cond)) [[unlikely]] _Throw(exception); \
+  } while (0)
+
+// Raises exception unless cond holds, in checked variants only. For what
+// only broken bytecode gets wrong, such as operand tags.
+#define CHECK(cond, exception) \
+  do { \
+    if constexpr (_Policy::kChecked) \
+    { \
+      if (!(cond)) _Throw(exception); \
+    } \
+  } while (0)
+
+#define CHECK_TYPE(v, type) CHECK((v).Is<type>(), "java.lang.VerifyError")
+
+#define NEXT() do { ++pc; DISPATCH(); } while (0)
+
+// The topmost operand is cached in tos and everything below it lives in
+// memory under sp. When the stack is empty tos holds whatever was in the
+// spare slot every frame keeps at the bottom of its operand area, so a push
+// can always spill tos without checking.
+#define PUSH(v) do { *sp++ = tos; tos = (v); } while (0)
+#define POP() (tos = *--sp)
+
+// Copies the topmost one or two operands in below the n operands under
+// them, what the DUP family does once the slot counting is sorted out.
+#define INSERT1(n) \
+  do { \
+    const std::ptrdiff_t kDepth = (n); \
+    std::copy_backward(sp - kDepth, sp, sp + 1); \
+    sp[-kDepth] = tos; \
+    sp++; \
+  } while (0)
+#define INSERT2(n) \
+  do { \
+    const std::ptrdiff_t kDepth = (n); \
+    std::copy_backward(sp - 1 - kDepth, sp, sp + 2); \
+    sp[-1 - kDepth] = sp[1]; \
+    sp[-kDepth] = tos; \
+    sp += 2; \
+  } while (0)
+
+// Registers are reloaded from the frame whenever the current frame changes.
+// Saved frames hold tos in memory like any other operand.
+#define LOAD_FRAME() \
+  do { klass = &frame->Owner(); code = frame->Method().Entry(); \
+       pc = frame->Pc(); sp = frame->Sp(); locals = frame->Locals(); } while (0)
+
+// Calls the method pc was quickened to. tos is spilled so all arguments sit
+// at the top of the operand area, they become the callee's first locals as
+// they are. The caller resumes after the call once the callee returns.
+#define CALL() \
+  do { \
+    *sp++ = tos; \
+    sp -= pc->b; \
+    if (pc->a) \
+    { \
+      _Spread(sp + pc->a - 1, pc->quick.method->Signature()); \
+    } \
+    frame->Save(pc + 1, sp); \
+    frame = &_PushFrame(*pc->quick.method, sp); \
+    LOAD_FRAME(); \
+    POP(); \
+    DISPATCH(); \
+  } while (0)
+
+// Drops the returning frame and reloads the caller's, or leaves the loop if
+// it was the bottom one.
+#define LEAVE() \
+  do { \
+    _frames.pop_back(); \
+    if (_frames.empty()) \
+    { \
+      EXIT(); \
+    } \
+    frame = &_frames.back(); \
+    LOAD_FRAME(); \
+  } while (0)
+
+#define MATH(op, type) \
+  HANDLER(op) \
+  { \
+    --sp; \
+    CHECK_TYPE(*sp, type); \
+    CHECK_TYPE(tos, type); \
+    tos = Value::From(_Math<type>(op, sp->As<type>(), tos.As<type>())); \
+    NEXT(); \
+  }
 
-    case BIPUSH:
-      frame.Push(static_cast<int>(kByteCode[++i]));
-      break;
+#define BITWISE(op, type) \
+  HANDLER(op) \
+  { \
+    --sp; \
+    CHECK_TYPE(*sp, type); \
+    tos = Value::From(_Bitwise<type>(op, sp->As<type>(), tos)); \
+    NEXT(); \
+  }
 
-    case ALOAD:
-      frame.Push(frame.At(kByteCode[++i]));
-      break;
+#define CONVERT(op, from, to) \
+  HANDLER(op) { CHECK_TYPE(tos, from); tos = Value::From(static_cast<to>(tos.As<from>())); NEXT(); }
 
-    case ILOAD:
-      frame.Push(std::any_cast<int>(frame.At(kByteCode[++i])));
-      break;
+#define IF_ZERO(op) \
+  HANDLER(op) \
+  { \
+    CHECK_TYPE(tos, int32_t); \
+    const int32_t kV = tos.As<int32_t>(); \
+    POP(); \
+    JUMP(_Cmp(op, kV, 0) ? code + pc->a : pc + 1); \
+  }
 
-    case ILOAD_0:
-    case ILOAD_1:
-    case ILOAD_2:
-    case ILOAD_3:
-      frame.Push(std::any_cast<int>(frame.At(kOpcode - ILOAD_0)));
-      break;
+// Superinstruction operands are two 16 bit halves of b.
+#define LO(v) (static_cast<uint32_t>(v) & 0xffff)
+#define HI(v) (static_cast<uint32_t>(v) >> 16)
 
-    case LLOAD_0:
-    case LLOAD_1:
-    case LLOAD_2:
-    case LLOAD_3:
-      frame.Push(std::any_cast<long>(frame.At(kOpcode - LLOAD_0)));
-      break;
+#define ILOAD_ILOAD_IF_CMP(op, cmp) \
+  HANDLER(op) \
+  { \
+    JUMP(_Cmp(cmp, locals[LO(pc->b)].As<int32_t>(), locals[HI(pc->b)].As<int32_t>()) ? code + pc->a : pc + 3); \
+  }
 
-    case FLOAD_0:
-    case FLOAD_1:
-    case FLOAD_2:
-    case FLOAD_3:
-      frame.Push(std::any_cast<float>(frame.At(kOpcode - FLOAD_0)));
-      break;
+#define IF_CMP(op) \
+  HANDLER(op) \
+  { \
+    CHECK_TYPE(sp[-1], int32_t); \
+    CHECK_TYPE(tos, int32_t); \
+    const bool kTaken = _Cmp(op, sp[-1].As<int32_t>(), tos.As<int32_t>()); \
+    --sp; \
+    POP(); \
+    JUMP(kTaken ? code + pc->a : pc + 1); \
+  }
 
-    case DLOAD_0:
-    case DLOAD_1:
-    case DLOAD_2:
-    case DLOAD_3:
-      frame.Push(std::any_cast<double>(frame.At(kOpcode - DLOAD_0)));
-      break;
+template<typename _Policy>
+void CppDuke::VirtualMachine::Interpreter::_Execute()
+{
+#if defined(CPPDUKE_THREADED_DISPATCH)
+  static const void *handlers[256];
+  static std::atomic<bool> ready{false};
+  if (!ready.load(std::memory_order_acquire))
+  {
+    static std::mutex lock;
+    std::lock_guard<std::mutex> guard{lock};
+    if (!ready.load(std::memory_order_relaxed))
+    {
+      std::fill(std::begin(handlers), std::end(handlers), &&L_INVALID);
+#define REGISTER(op) handlers[op] = &&L_##op;
+      HANDLERS(REGISTER)
+#undef REGISTER
+      ready.store(true, std::memory_order_release);
+    }
+  }
+#else
+  static const void *const *handlers = nullptr;
+#endif
+
+  // Calls and returns only push and pop activation records, this loop keeps
+  // going until the bottom frame returns. A green thread that left it picks
+  // up where its top frame was saved.
+  [[maybe_unused]] uint64_t executed = 0;
+
+  Frame *frame = &_frames.back();
+  const Klass *klass;
+  const Instruction *code, *pc;
+  Value *sp, *locals;
+  Value tos;
+
+  if (!frame->Method().ThreadedWith(handlers))
+  {
+    const_cast<DecodedMethod &>(frame->Method()).Thread(handlers);
+  }
+  LOAD_FRAME();
+  POP();
 
-    case ALOAD_0:
-    case ALOAD_1:
-    case ALOAD_2:
-    case ALOAD_3:
-      frame.Push(frame.At(kOpcode - ALOAD_0));
-      break;
+#if defined(CPPDUKE_THREADED_DISPATCH)
+  DISPATCH();
+  {
+#else
+  dispatch:
+  ACCOUNT();
+  redispatch:
+  switch (pc->opcode)
+  {
+#endif
+    HANDLER(NOP)
+      NEXT();
+
+    HANDLER(ACONST_NULL)
+      PUSH(Value::From(nullptr));
+      NEXT();
+
+    // ICONST_<i>, BIPUSH and SIPUSH.
+    HANDLER(SIPUSH)
+      PUSH(Value::From<int32_t>(pc->a));
+      NEXT();
+
+    HANDLER(LCONST_0)
+      PUSH(Value::From<int64_t>(pc->a));
+      NEXT();
+
+    HANDLER(FCONST_0)
+      PUSH(Value::From<float>(pc->a));
+      NEXT();
+
+    HANDLER(DCONST_0)
+      PUSH(Value::From<double>(pc->a));
+      NEXT();
+
+    // LDC, LDC_W and LDC2_W.
+    HANDLER(LDC)
+      QUICKEN();
+
+    HANDLER(LDC_QUICK)
+      PUSH(*pc->quick.slot);
+      NEXT();
+
+    // All of <t>LOAD and <t>LOAD_<n>.
+    HANDLER(ILOAD)
+      PUSH(locals[pc->a]);
+      NEXT();
+
+    // All of <t>STORE and <t>STORE_<n>.
+    HANDLER(ISTORE)
+      locals[pc->a] = tos;
+      POP();
+      NEXT();
+
+    // All of <t>ALOAD.
+    HANDLER(IALOAD)
+    {
+      Array *arr = (--sp)->As<Array *>();
+      GUARD(arr != nullptr, "java.lang.NullPointerException");
+      GUARD(tos.As<int32_t>() >= 0 && static_cast<std::size_t>(tos.As<int32_t>()) < arr->Length(),
+            "java.lang.ArrayIndexOutOfBoundsException");
+      tos = (*arr)[tos.As<int32_t>()];
+      NEXT();
+    }
 
-    case AALOAD:
-    case BALOAD:
-    case CALOAD:
-    case IALOAD:
-    case LALOAD:
-    case FALOAD:
-    case DALOAD:
+    // All of <t>ASTORE.
+    HANDLER(IASTORE)
     {
-      // Implement type check here.
-      int pos = std::any_cast<int>(frame.Pop());
-      std::shared_ptr<std::vector<std::any>> arr = std::any_cast<std::shared_ptr<std::vector<std::any>>>(frame.Pop());
-      frame.Push((*arr)[pos]);
-      break;
+      sp -= 2;
+      Array *arr = sp[0].As<Array *>();
+      GUARD(arr != nullptr, "java.lang.NullPointerException");
+      GUARD(sp[1].As<int32_t>() >= 0 && static_cast<std::size_t>(sp[1].As<int32_t>()) < arr->Length(),
+            "java.lang.ArrayIndexOutOfBoundsException");
+      (*arr)[sp[1].As<int32_t>()] = tos;
+      POP();
+      NEXT();
     }
 
-    case ASTORE:
-      frame.Set(kByteCode[++i], frame.Pop());
-      break;
+    HANDLER(POP)
+      POP();
+      NEXT();
 
-    case ISTORE:
-      frame.Set(kByteCode[++i], std::any_cast<int>(frame.Pop()));
-      break;
+    // The spec counts slots, a long or double is two of them. Here it is a
+    // single operand, so what "two slots" means depends on the tags.
+    HANDLER(POP2)
+      if (!tos.IsWide())
+      {
+        --sp;
+      }
+      POP();
+      NEXT();
 
-    case ISTORE_0:
-    case ISTORE_1:
-    case ISTORE_2:
-    case ISTORE_3:
-      frame.Set(kOpcode - ISTORE_0, std::any_cast<int>(frame.Pop()));
-      break;
+    HANDLER(DUP)
+      // Duplicate the element on top of the stack.
+      *sp++ = tos;
+      NEXT();
 
-    case LSTORE_0:
-    case LSTORE_1:
-    case LSTORE_2:
-    case LSTORE_3:
-      frame.Set(kOpcode - LSTORE_0, std::any_cast<long>(frame.Pop()));
-      break;
+    HANDLER(DUP_X1)
+      INSERT1(1);
+      NEXT();
 
-    case FSTORE_0:
-    case FSTORE_1:
-    case FSTORE_2:
-    case FSTORE_3:
-      frame.Set(kOpcode - FSTORE_0, std::any_cast<float>(frame.Pop()));
-      break;
+    HANDLER(DUP_X2)
+      INSERT1(sp[-1].IsWide() ? 1 : 2);
+      NEXT();
 
-    case DSTORE_0:
-    case DSTORE_1:
-    case DSTORE_2:
-    case DSTORE_3:
-      frame.Set(kOpcode - DSTORE_0, std::any_cast<double>(frame.Pop()));
-      break;
+    HANDLER(DUP2)
+      if (tos.IsWide())
+      {
+        INSERT1(0);
+      } else
+      {
+        INSERT2(0);
+      }
+      NEXT();
 
-    case ASTORE_0:
-    case ASTORE_1:
-    case ASTORE_2:
-    case ASTORE_3:
-      frame.Set(kOpcode - ASTORE_0, frame.Pop());
-      break;
+    HANDLER(DUP2_X1)
+      if (tos.IsWide())
+      {
+        INSERT1(1);
+      } else
+      {
+        INSERT2(1);
+      }
+      NEXT();
 
-    case BASTORE:
-    case CASTORE:
-    case IASTORE:
-    case LASTORE:
-    case FASTORE:
-    case DASTORE:
+    HANDLER(DUP2_X2)
+      if (tos.IsWide())
+      {
+        INSERT1(sp[-1].IsWide() ? 1 : 2);
+      } else
+      {
+        INSERT2(sp[-2].IsWide() ? 1 : 2);
+      }
+      NEXT();
+
+    HANDLER(SWAP)
+      std::swap(sp[-1], tos);
+      NEXT();
+
+    MATH(IADD, int32_t)
+    MATH(ISUB, int32_t)
+    MATH(IMUL, int32_t)
+    MATH(IDIV, int32_t)
+    MATH(LADD, int64_t)
+    MATH(LSUB, int64_t)
+    MATH(LMUL, int64_t)
+    MATH(LDIV, int64_t)
+    MATH(FADD, float)
+    MATH(FSUB, float)
+    MATH(FMUL, float)
+    MATH(FDIV, float)
+    MATH(DADD, double)
+    MATH(DSUB, double)
+    MATH(DMUL, double)
+    MATH(DDIV, double)
+
+    BITWISE(ISHL, int32_t)
+    BITWISE(ISHR, int32_t)
+    BITWISE(IAND, int32_t)
+    BITWISE(IOR, int32_t)
+    BITWISE(IXOR, int32_t)
+    BITWISE(LSHL, int64_t)
+    BITWISE(LSHR, int64_t)
+    BITWISE(LAND, int64_t)
+    BITWISE(LOR, int64_t)
+    BITWISE(LXOR, int64_t)
+
+    HANDLER(IINC)
+      locals[pc->a] = Value::From(locals[pc->a].As<int32_t>() + pc->b);
+      NEXT();
+
+    CONVERT(I2L, int32_t, int64_t)
+    CONVERT(I2F, int32_t, float)
+    CONVERT(I2D, int32_t, double)
+    CONVERT(L2I, int64_t, int32_t)
+    CONVERT(L2F, int64_t, float)
+    CONVERT(L2D, int64_t, double)
+    CONVERT(F2I, float, int32_t)
+    CONVERT(F2L, float, int64_t)
+    CONVERT(F2D, float, double)
+    CONVERT(D2I, double, int32_t)
+    CONVERT(D2L, double, int64_t)
+    CONVERT(D2F, double, float)
+    CONVERT(I2C, int32_t, uint16_t)
+
+    IF_ZERO(IFEQ)
+    IF_ZERO(IFNEQ)
+    IF_ZERO(IFLT)
+    IF_ZERO(IFGE)
+    IF_ZERO(IFGT)
+    IF_ZERO(IFLE)
+    IF_CMP(IF_ICMPEQ)
+    IF_CMP(IF_ICMPNE)
+    IF_CMP(IF_ICMPLT)
+    IF_CMP(IF_ICMPGE)
+    IF_CMP(IF_ICMPGT)
+    IF_CMP(IF_ICMPLE)
+
+    // GOTO and GOTO_W.
+    HANDLER(GOTO)
+      JUMP(code + pc->a);
+
+    HANDLER(IFNULL)
     {
-      std::any e = frame.Pop();
-      int pos = std::any_cast<int>(frame.Pop());
-      std::any container = frame.Pop();
-
-      std::shared_ptr<std::vector<std::any>> arr = std::any_cast<std::shared_ptr<std::vector<std::any>>>(container);
-      (*arr)[pos] = e;
+      const bool kTaken = tos.IsNull();
+      POP();
+      JUMP(kTaken ? code + pc->a : pc + 1);
+    }
 
-      break;
+    HANDLER(IFNONNULL)
+    {
+      const bool kTaken = !tos.IsNull();
+      POP();
+      JUMP(kTaken ? code + pc->a : pc + 1);
     }
 
-    case POP:
-      frame.Pop();
-      break;
+    HANDLER(INVOKESTATIC)
+    HANDLER(INVOKESPECIAL)
+    HANDLER(INVOKEVIRTUAL)
+      QUICKEN();
+
+    // Invokes once the call site knows its target.
+    HANDLER(INVOKE_QUICK)
+      POLL(pc);
+      CALL();
+
+    // Static methods lock their class, others their receiver, which is the
+    // first argument below all the others.
+    HANDLER(INVOKE_SYNCHRONIZED)
+      POLL(pc);
+      if (!_Lock(pc->quick.method->Monitor() ? pc->quick.method->Monitor()
+                                             : (pc->b == 1 ? tos : sp[1 - pc->b]).As<Object *>()))
+      {
+        RETRY();
+      }
+      CALL();
+
+    // All of <t>RETURN except RETURN. The caller's own top was spilled when
+    // it made the call, the return value simply becomes its new tos.
+    HANDLER(IRETURN)
+      CHECK(_Returns(frame->Method().Signature().Return(), tos), "java.lang.VerifyError");
+      LEAVE();
+      DISPATCH();
+
+    // The monitor taken by INVOKE_SYNCHRONIZED is the innermost one held,
+    // anything locked since has been unlocked again.
+    HANDLER(IRETURN_SYNCHRONIZED)
+      CHECK(_Returns(frame->Method().Signature().Return(), tos), "java.lang.VerifyError");
+      _Unlock(_monitors.back());
+      LEAVE();
+      DISPATCH();
+
+    HANDLER(RETURN)
+      LEAVE();
+      POP();
+      DISPATCH();
+
+    HANDLER(RETURN_SYNCHRONIZED)
+      _Unlock(_monitors.back());
+      LEAVE();
+      POP();
+      DISPATCH();
+
+    HANDLER(NEW)
+    HANDLER(GETSTATIC)
+    HANDLER(PUTSTATIC)
+    HANDLER(GETFIELD)
+    HANDLER(PUTFIELD)
+      QUICKEN();
+
+    HANDLER(NEW_THREAD)
+      PUSH(Value::From<Object *>(_Allocate<Thread>()));
+      NEXT();
+
+    // Arguments are taken off the stack like for any call, natives return
+    // nothing. They stay on it if the call has to be made again.
+    HANDLER(INVOKE_NATIVE)
+      *sp++ = tos;
+      if (!_Native(pc->a, sp - pc->b))
+      {
+        --sp;
+        RETRY();
+      }
+      sp -= pc->b;
+      POP();
+      NEXT();
 
-    case POP2:
-      frame.Pop();
-      frame.Pop();
-      break;
+    HANDLER(MONITORENTER)
+      if (!_Lock(tos.As<Object *>()))
+      {
+        RETRY();
+      }
+      POP();
+      NEXT();
+
+    HANDLER(MONITOREXIT)
+      _Unlock(tos.As<Object *>());
+      POP();
+      NEXT();
 
-    case DUP:
+    HANDLER(NEW_QUICK)
     {
-      // Duplicate the element on frame of the stack.
-      frame.Push(frame.Top());
-      break;
+      const Layout *layout = pc->quick.layout;
+      PUSH(Value::From(_Allocate<Object>(layout->klass, layout->defaults)));
+      NEXT();
     }
 
-    case DUP2:
-    {
-      std::any v1 = frame.Pop();
-      std::any v2 = frame.Pop();
+    HANDLER(GETSTATIC_QUICK)
+      PUSH(*pc->quick.slot);
+      NEXT();
 
-      frame.Push(v2);
-      frame.Push(v1);
-      frame.Push(v2);
-      frame.Push(v1);
-      break;
-    }
+    HANDLER(PUTSTATIC_QUICK)
+      *pc->quick.slot = tos;
+      POP();
+      NEXT();
 
-    case IFEQ:
-    case IFNEQ:
-    case IFLT:
-    case IFGE:
-    case IFGT:
-    case IFLE:
-    case IF_ICMPEQ:
-    case IF_ICMPNE:
-    case IF_ICMPLT:
-    case IF_ICMPGE:
-    case IF_ICMPGT:
-    case IF_ICMPLE:
+    HANDLER(GETFIELD_QUICK)
+      GUARD(!tos.IsNull(), "java.lang.NullPointerException");
+      tos = tos.As<Object *>()->Field(pc->a);
+      NEXT();
+
+    HANDLER(PUTFIELD_QUICK)
+      --sp;
+      GUARD(!sp->IsNull(), "java.lang.NullPointerException");
+      sp->As<Object *>()->Field(pc->a) = tos;
+      POP();
+      NEXT();
+
+    HANDLER(NEWARRAY)
     {
-      if (_Cmp(kOpcode))
+      // Elements start out as the zero value of the array's component type.
+      Value init;
+      switch (pc->a)
       {
-        i += TWO_BYTE_CONSTRUCT(kByteCode, i) - 1;
-      } else
-      {
-        i += 2;
+        case 6: // T_FLOAT
+          init = Value::From(0.0f);
+          break;
+        case 7: // T_DOUBLE
+          init = Value::From(0.0);
+          break;
+        case 11: // T_LONG
+          init = Value::From<int64_t>(0);
+          break;
+        default:
+          init = Value::From<int32_t>(0);
+          break;
       }
 
-      return;
+      GUARD(tos.As<int32_t>() >= 0, "java.lang.NegativeArraySizeException");
+      tos = Value::From(_Allocate<Array>(tos.As<int32_t>(), init));
+      NEXT();
     }
 
-    case SWAP:
+    HANDLER(ARRAYLENGTH)
+      GUARD(!tos.IsNull(), "java.lang.NullPointerException");
+      tos = Value::From(static_cast<int32_t>(tos.As<Array *>()->Length()));
+      NEXT();
+
+    ILOAD_ILOAD_IF_CMP(ILOAD_ILOAD_IF_ICMPEQ, IF_ICMPEQ)
+    ILOAD_ILOAD_IF_CMP(ILOAD_ILOAD_IF_ICMPNE, IF_ICMPNE)
+    ILOAD_ILOAD_IF_CMP(ILOAD_ILOAD_IF_ICMPLT, IF_ICMPLT)
+    ILOAD_ILOAD_IF_CMP(ILOAD_ILOAD_IF_ICMPGE, IF_ICMPGE)
+    ILOAD_ILOAD_IF_CMP(ILOAD_ILOAD_IF_ICMPGT, IF_ICMPGT)
+    ILOAD_ILOAD_IF_CMP(ILOAD_ILOAD_IF_ICMPLE, IF_ICMPLE)
+
+    HANDLER(ILOAD_ICONST_IADD_ISTORE)
+      locals[HI(pc->b)] = Value::From(locals[LO(pc->b)].As<int32_t>() + pc->a);
+      pc += 4;
+      DISPATCH();
+
+    HANDLER(ILOAD_ILOAD_IALOAD)
+      GUARD(!locals[LO(pc->b)].IsNull(), "java.lang.NullPointerException");
+      GUARD(locals[HI(pc->b)].As<int32_t>() >= 0
+            && static_cast<std::size_t>(locals[HI(pc->b)].As<int32_t>())
+               < locals[LO(pc->b)].As<Array *>()->Length(),
+            "java.lang.ArrayIndexOutOfBoundsException");
+      PUSH((*locals[LO(pc->b)].As<Array *>())[locals[HI(pc->b)].As<int32_t>()]);
+      pc += 3;
+      DISPATCH();
+
+    HANDLER(IINC_GOTO)
     {
-      std::any v1 = frame.Pop();
-      std::any v2 = frame.Pop();
-
-      frame.Push(v1);
-      frame.Push(v2);
-
-      break;
+      // The increment sits in the upper half, sign extended.
+      Value &v = locals[LO(pc->b)];
+      v = Value::From(v.As<int32_t>() + (pc->b >> 16));
+      JUMP(code + pc->a);
     }
 
-    case IADD:
-    case ISUB:
-    case IMUL:
-    case IDIV:
-      frame.Push(_Math<int>(kOpcode));
-      break;
-
-    case LADD:
-    case LSUB:
-    case LMUL:
-    case LDIV:
-      frame.Push(_Math<long>(kOpcode));
-      break;
+    HANDLER(BREAKPOINT)
+    HANDLER(IMPDEP1)
+    HANDLER(IMPDEP2)
+      // Reserved. Decide what to do later.
+      NEXT();
 
-    case FADD:
-    case FSUB:
-    case FMUL:
-    case FDIV:
-      frame.Push(_Math<float>(kOpcode));
-      break;
+#if defined(CPPDUKE_THREADED_DISPATCH)
+    L_INVALID:
+#else
+    default:
+#endif
+      throw std::invalid_argument("Invalid opcode");
+  }
+}
 
-    case DADD:
-    case DSUB:
-    case DMUL:
-    case DDIV:
-      frame.Push(_Math<double>(kOpcode));
-      break;
+namespace
+{
+using namespace CppDuke::VirtualMachine;
+
+// The variants that get compiled, in order of preference. The first one that
+// has every requested feature runs.
+using Production = Features<false, false, false, false>;
+using Profiling = Features<false, true, false, false>;
+using Checked = Features<false, false, true, false>;
+using Safepoints = Features<false, false, false, true>;
+using Diagnostic = Features<false, true, true, true>;
+using Tracing = Features<true, true, true, true>;
+}
 
-    case INVOKESTATIC:
-    {
-      std::shared_ptr<ConstantPool::GenericEntry> methodRef = klass.ResolveLowHigh(
-          TWO_BYTE_CONSTRUCT(kByteCode, i));
-      int argCount;
-      std::shared_ptr<ConstantPool::CodeAttribute> method = klass.Invoke(methodRef->Low(),
-                                                                              methodRef->High(),
-                                                                              argCount);
-      _ExecMethod(method->ByteCode(), method->BufferSize(), argCount);
-
-      i += 2;
-      break;
-    }
+CppDuke::VirtualMachine::Interpreter::Executor CppDuke::VirtualMachine::Interpreter::_SelectExecutor() const
+{
+  const bool kProfile = _stats || _ngrams;
+  auto covers = [&]<typename _Policy>(_Policy) -> bool
+  {
+    return (_Policy::kTrace || !_trace)
+           && (_Policy::kProfile || !kProfile)
+           && (_Policy::kChecked || !_checked)
+           && (_Policy::kSafepoints || !_safepoints);
+  };
 
-    case ISHL:
-    case ISHR:
-    case IAND:
-    case IOR:
-    case IXOR:
-      frame.Push(_Bitwise<int>(kOpcode));
-      break;
+  if (covers(Production{}))
+  {
+    return &Interpreter::_Execute<Production>;
+  }
+  if (covers(Profiling{}))
+  {
+    return &Interpreter::_Execute<Profiling>;
+  }
+  if (covers(Checked{}))
+  {
+    return &Interpreter::_Execute<Checked>;
+  }
+  if (covers(Safepoints{}))
+  {
+    return &Interpreter::_Execute<Safepoints>;
+  }
+  if (covers(Diagnostic{}))
+  {
+    return &Interpreter::_Execute<Diagnostic>;
+  }
 
-    case LSHL:
-    case LSHR:
-    case LAND:
-    case LOR:
-    case LXOR:
-      frame.Push(_Bitwise<long>(kOpcode));
-      break;
+  return &Interpreter::_Execute<Tracing>;
+}
 
-    case IINC:
-    {
-      int v = std::any_cast<int>(frame.At(kByteCode[i + 1])) + kByteCode[i + 2];
-      frame.Set(kByteCode[i + 1], v);
+bool CppDuke::VirtualMachine::Interpreter::_Safepoint()
+{
+  // Nothing runs at a safepoint yet, the request is simply acknowledged.
+  // Green threads take it as their cue to let others run.
+  _safepoint.store(false, std::memory_order_relaxed);
+  return _green;
+}
 
-      i += 2;
-      return;
-    }
+void CppDuke::VirtualMachine::Interpreter::_Throw(const char *exception)
+{
+  // Java exceptions cannot be caught by the program yet, they end the run.
+  throw std::runtime_error(exception);
+}
 
-    case I2L:
-      frame.Push(static_cast<long>(std::any_cast<int>(frame.Pop())));
-      break;
+CppDuke::VirtualMachine::Frame &
+CppDuke::VirtualMachine::Interpreter::_PushFrame(const DecodedMethod &method, Value *locals)
+{
+  if (_frames.size() == _frames.capacity()
+      || locals + method.MaxLocals() + method.MaxStack() + 1 > _stack.data() + _stack.size())
+  {
+    throw std::overflow_error("java.lang.StackOverflowError");
+  }
 
-    case I2F:
-      frame.Push(static_cast<float>(std::any_cast<int>(frame.Pop())));
-      break;
+  return _frames.emplace_back(method, locals);
+}
 
-    case I2D:
-      frame.Push(static_cast<double>(std::any_cast<int>(frame.Pop())));
-      break;
+namespace
+{
+// Methods of java.lang.Thread, which is built in rather than loaded. A
+// thread runs the Runnable it was made with, Thread cannot be subclassed
+// since superclasses are not supported.
+typedef enum : int32_t
+{
+  THREAD_INIT,
+  THREAD_START,
+  THREAD_JOIN,
+  THREAD_YIELD,
+} Native;
 
-    case L2I:
-      frame.Push(static_cast<int>(std::any_cast<long>(frame.Pop())));
-      break;
+struct NativeMethod
+{
+  const char *name, *descriptor;
+  Native native;
+  // Operands taken off the stack, the receiver included.
+  int32_t operands;
+};
+
+constexpr NativeMethod kNatives[] = {
+    {"<init>", "(Ljava/lang/Runnable;)V", THREAD_INIT, 2},
+    {"start", "()V", THREAD_START, 1},
+    {"join", "()V", THREAD_JOIN, 1},
+    {"yield", "()V", THREAD_YIELD, 0},
+};
+}
 
-    case L2F:
-      frame.Push(static_cast<float>(std::any_cast<long>(frame.Pop())));
-      break;
+void CppDuke::VirtualMachine::Interpreter::_Invoke(const DecodedMethod &method, Value *locals)
+{
+  if (method.Synchronized())
+  {
+    _Lock(method.Monitor() ? method.Monitor() : locals[0].As<Object *>());
+  }
 
-    case L2D:
-      frame.Push(static_cast<double>(std::any_cast<long>(frame.Pop())));
-      break;
+  _PushFrame(method, locals);
+  (this->*_execute)();
+}
 
-    case F2I:
-      frame.Push(static_cast<int>(std::any_cast<float>(frame.Pop())));
-      break;
+bool CppDuke::VirtualMachine::Interpreter::_Lock(Object *object)
+{
+  if (object == nullptr)
+  {
+    _Throw("java.lang.NullPointerException");
+  }
 
-    case F2L:
-      frame.Push(static_cast<long>(std::any_cast<float>(frame.Pop())));
-      break;
+  if (!_green)
+  {
+    object->Monitor().Enter(_self);
+  } else if (!object->Monitor().TryEnter(_self))
+  {
+    return false;
+  }
 
-    case F2D:
-      frame.Push(static_cast<double>(std::any_cast<float>(frame.Pop())));
-      break;
+  _monitors.push_back(object);
+  return true;
+}
 
-    case D2I:
-      frame.Push(static_cast<int>(std::any_cast<double>(frame.Pop())));
-      break;
+void CppDuke::VirtualMachine::Interpreter::_Unlock(Object *object)
+{
+  if (object == nullptr)
+  {
+    _Throw("java.lang.NullPointerException");
+  }
 
-    case D2L:
-      frame.Push(static_cast<long>(std::any_cast<double>(frame.Pop())));
-      break;
+  // Monitors are released in the reverse order they were taken in, the
+  // search ends at once unless the bytecode was not made by javac.
+  auto held = std::find(std::rbegin(_monitors), std::rend(_monitors), object);
+  if (held == std::rend(_monitors) || !object->Monitor().Exit(_self))
+  {
+    _Throw("java.lang.IllegalMonitorStateException");
+  }
 
-    case D2F:
-      frame.Push(static_cast<float>(std::any_cast<double>(frame.Pop())));
-      break;
+  _monitors.erase(std::next(held).base());
+}
 
-    case I2C:
-      frame.Push(static_cast<char>(std::any_cast<int>(frame.Pop())));
-      break;
+void CppDuke::VirtualMachine::Interpreter::_UnlockAll()
+{
+  while (!_monitors.empty())
+  {
+    _monitors.back()->Monitor().Exit(_self);
+    _monitors.pop_back();
+  }
+}
 
-    case GOTO:
+bool CppDuke::VirtualMachine::Interpreter::_Native(const int32_t native, Value *args)
+{
+  // Static, the only one. A green thread yields at its next poll.
+  if (native == THREAD_YIELD)
+  {
+    if (_green)
     {
-      // Offset used here is relative and not absolute.
-      i += TWO_BYTE_CONSTRUCT(kByteCode, i) - 1;
-      return;
+      _safepoint.store(true, std::memory_order_relaxed);
+    } else
+    {
+      std::this_thread::yield();
     }
+    return true;
+  }
 
-    case LDC:
-      frame.Push(klass.Ldc(kByteCode[++i]));
-      break;
+  auto *thread = args[0].As<Thread *>();
+  if (thread == nullptr)
+  {
+    _Throw("java.lang.NullPointerException");
+  }
 
-    case IRETURN:
-      rval = std::any_cast<int>(frame.Pop());
+  switch (native)
+  {
+    case THREAD_INIT:
+      thread->SetTarget(args[1].As<Object *>());
       break;
-
-    case LRETURN:
-      rval = std::any_cast<long>(frame.Pop());
+    case THREAD_START:
+      _Start(*thread);
       break;
-
-    case FRETURN:
-      rval = std::any_cast<float>(frame.Pop());
+    case THREAD_JOIN:
+      if (_green && !thread->Finished())
+      {
+        return false;
+      }
+      thread->Join();
       break;
+    default:
+      throw std::invalid_argument("Invalid native: " + std::to_string(native));
+  }
 
-    case DRETURN:
-      rval = std::any_cast<double>(frame.Pop());
-      break;
+  return true;
+}
 
-    case ARETURN:
-      rval = frame.Pop();
-      break;
+void CppDuke::VirtualMachine::Interpreter::_Start(Thread &thread)
+{
+  if (!thread.Start())
+  {
+    _Throw("java.lang.IllegalThreadStateException");
+  }
 
-    case RETURN:
-      break;
+  std::lock_guard<std::mutex> guard{_program.lock};
+  const std::size_t kId = _program.threads.size();
+  Interpreter &started = *_program.threads.emplace_back(new Interpreter(*this, _program));
+  if (_program.scheduler)
+  {
+    _program.scheduler->Spawn(started._RunGreen(thread, kId));
+    return;
+  }
 
-    case NEW:
-    {
-      int cc = TWO_BYTE_CONSTRUCT(kByteCode, i);
-      std::vector<std::shared_ptr<ConstantPool::PoolEntry>> pool = klass.Pool();
-      uint16_t ni = std::dynamic_pointer_cast<ConstantPool::KlassInfo>(pool[cc - 1])->NameIndex();
-      std::string name = std::dynamic_pointer_cast<ConstantPool::Utf8>(pool[ni - 1])->Data();
+  try
+  {
+    _program.running.emplace_back(&Interpreter::_RunThread, &started, std::ref(thread), kId);
+  } catch (const std::system_error &)
+  {
+    _program.threads.pop_back();
+    thread.Finish();
+    _Throw("java.lang.OutOfMemoryError: unable to create native thread");
+  }
+}
 
-      frame.Push(_klasses.find(name)->second);
+const CppDuke::VirtualMachine::DecodedMethod &CppDuke::VirtualMachine::Interpreter::_RunMethod(const Object &target)
+{
+  static const Symbol kRun = SymbolTable::Intern("run");
+  static const Symbol kVoid = SymbolTable::Intern("()V");
 
-      i += 2;
-      break;
+  const Klass *klass = target.GetKlass();
+  const std::size_t kPos = klass ? klass->FindMethod(kRun, kVoid) : MemberIndex::kNotFound;
+  if (kPos == MemberIndex::kNotFound || !klass->Codes()[kPos])
+  {
+    _Throw("java.lang.AbstractMethodError: run");
+  }
+
+  return _Decoded(*klass, kPos);
+}
+
+void CppDuke::VirtualMachine::Interpreter::_Uncaught(const std::size_t id)
+{
+  // Nothing stops the other threads, the program goes on without this one.
+  _UnlockAll();
+  try
+  {
+    throw;
+  } catch (const std::runtime_error &e)
+  {
+    fprintf(stderr, "Exception in thread \"Thread-%zu\" %s\n", id, e.what());
+  } catch (const std::exception &e)
+  {
+    fprintf(stderr, "Error: %s\n", e.what());
+  }
+}
+
+void CppDuke::VirtualMachine::Interpreter::_RunThread(Thread &thread, const std::size_t id)
+{
+  try
+  {
+    Object *target = thread.Target();
+    if (target != nullptr)
+    {
+      const DecodedMethod &run = _RunMethod(*target);
+      _stack[0] = Value::From(target);
+      _Invoke(run, _stack.data());
     }
+  } catch (...)
+  {
+    _Uncaught(id);
+  }
+
+  thread.Finish();
+}
 
-    case NEWARRAY:
+CppDuke::Scheduler::Green CppDuke::VirtualMachine::Interpreter::_RunGreen(Thread &thread, const std::size_t id)
+{
+  Scheduler &scheduler = *_program.scheduler;
+  try
+  {
+    Object *target = thread.Target();
+    if (target != nullptr)
     {
-      std::shared_ptr<std::vector<std::any>> arr = std::make_shared<std::vector<std::any>>();
-      arr->resize(any_cast<int>(frame.Pop()));
-      frame.Push(arr);
+      const DecodedMethod &run = _RunMethod(*target);
+      _stack[0] = Value::From(target);
+      while (run.Synchronized() && !_Lock(run.Monitor() ? run.Monitor() : target))
+      {
+        co_await scheduler.Yield();
+      }
 
-      // Skip atype for now.
-      i++;
-      break;
+      // Each turn runs until the thread returns or yields, its frames
+      // stay put in between.
+      _PushFrame(run, _stack.data());
+      for (;;)
+      {
+        scheduler.Preemptible(_safepoint);
+        (this->*_execute)();
+        if (_frames.empty())
+        {
+          break;
+        }
+        co_await scheduler.Yield();
+      }
     }
+  } catch (...)
+  {
+    _Uncaught(id);
+  }
 
-    case ARRAYLENGTH:
-      frame.Push(std::any_cast<std::shared_ptr<std::vector<std::any>>>(frame.Pop())->size());
-      break;
+  thread.Finish();
+}
+
+void CppDuke::VirtualMachine::Interpreter::_JoinThreads()
+{
+  // Started threads are either all green or none is.
+  if (_program.scheduler)
+  {
+    _program.scheduler->Wait();
+    return;
+  }
 
-    case IFNULL:
-      if (frame.Pop().type() == typeid(nullptr))
+  for (;;)
+  {
+    std::thread running;
+    {
+      std::lock_guard<std::mutex> guard{_program.lock};
+      if (_program.running.empty())
       {
-        // Offset used here is relative and not absolute.
-        i += TWO_BYTE_CONSTRUCT(kByteCode, i) - 1;
+        return;
       }
-      break;
+      running = std::move(_program.running.front());
+      _program.running.pop_front();
+    }
 
-    case IFNONNULL:
-      if (frame.Pop().type() != typeid(nullptr))
+    running.join();
+  }
+}
+
+// Handlers leave through a computed goto, which skips destructors, so
+// anything that needs temporaries lives out of line.
+CppDuke::VirtualMachine::DecodedMethod *
+CppDuke::VirtualMachine::Interpreter::_ResolveMethod(const Klass &klass, const uint16_t idx)
+{
+  // java.lang.Object is not loaded, its constructor does nothing anyway.
+  static const Symbol kObject = SymbolTable::Intern("java/lang/Object");
+
+  const ConstantPool::MemberRef kRef = klass.Pool().Member(idx);
+  if (kRef.klass == kObject)
+  {
+    return nullptr;
+  }
+
+  // The method is looked up in the class the reference names, which need
+  // not be the caller's.
+  const Klass &owner = _ResolveKlass(kRef.klass);
+  const std::size_t kPos = owner.FindMethod(kRef.name, kRef.descriptor);
+  if (kPos == MemberIndex::kNotFound || !owner.Codes()[kPos])
+  {
+    throw std::runtime_error("java.lang.NoSuchMethodError: " + *owner.Name() + "." + *kRef.name);
+  }
+
+  return &_Decoded(owner, kPos);
+}
+
+void CppDuke::VirtualMachine::Interpreter::_Quicken(const Klass &klass,
+                                                    Instruction &ins,
+                                                    const void *const *handlers)
+{
+  _Resolve(klass, ins);
+  if (handlers)
+  {
+    ins.handler = handlers[ins.opcode];
+  }
+
+  // A quick call goes straight to its callee's first handler.
+  if ((ins.opcode == INVOKE_QUICK || ins.opcode == INVOKE_SYNCHRONIZED)
+      && !ins.quick.method->ThreadedWith(handlers))
+  {
+    ins.quick.method->Thread(handlers);
+  }
+}
+
+void CppDuke::VirtualMachine::Interpreter::_Resolve(const Klass &klass, Instruction &ins)
+{
+  static const Symbol kThread = SymbolTable::Intern("java/lang/Thread");
+
+  if (ins.opcode == LDC)
+  {
+    const ConstantPool::Pool &kPool = klass.Pool();
+    switch (kPool.Tag(ins.a))
+    {
+      case ConstantPool::INTEGER:
+        _constants.push_back(Value::From(kPool.Integer(ins.a)));
+        break;
+      case ConstantPool::FLOAT:
+        _constants.push_back(Value::From(kPool.Float(ins.a)));
+        break;
+      case ConstantPool::LONG:
+        _constants.push_back(Value::From(kPool.Long(ins.a)));
+        break;
+      case ConstantPool::CONST_DOUBLE:
+        _constants.push_back(Value::From(kPool.Double(ins.a)));
+        break;
+      case ConstantPool::STRING:
+        _constants.push_back(Value::From<Object *>(_Intern(kPool.String(ins.a))));
+        break;
+      default:
+        throw std::invalid_argument("Unsupported constant: " + std::to_string(ins.a));
+    }
+
+    ins.quick.slot = &_constants.back();
+    ins.opcode = LDC_QUICK;
+    return;
+  }
+
+  if (ins.opcode == NEW && klass.Pool().KlassName(ins.a) == kThread)
+  {
+    ins.opcode = NEW_THREAD;
+    return;
+  }
+
+  if (ins.opcode == NEW)
+  {
+    ins.quick.layout = &_Link(_ResolveKlass(klass.Pool().KlassName(ins.a)));
+    ins.opcode = NEW_QUICK;
+    return;
+  }
+
+  if (ins.opcode == INVOKESTATIC || ins.opcode == INVOKESPECIAL || ins.opcode == INVOKEVIRTUAL)
+  {
+    const ConstantPool::MemberRef kRef = klass.Pool().Member(ins.a);
+    if (kRef.klass == kThread)
+    {
+      auto native = std::find_if(std::begin(kNatives),
+                                 std::end(kNatives),
+                                 [&](const NativeMethod &m) { return *kRef.name == m.name && *kRef.descriptor == m.descriptor; });
+      if (native == std::end(kNatives))
       {
-        // Offset used here is relative and not absolute.
-        i += TWO_BYTE_CONSTRUCT(kByteCode, i) - 1;
+        throw std::runtime_error("java.lang.NoSuchMethodError: java/lang/Thread." + *kRef.name);
       }
-      break;
 
-    case GOTO_W:
-      i += (kByteCode[i + 1] << 24) | (kByteCode[i + 2] << 16) | (kByteCode[i + 3] << 8) | kByteCode[i + 4];
+      ins.a = native->native;
+      ins.b = native->operands;
+      ins.opcode = INVOKE_NATIVE;
       return;
+    }
 
-    case BREAKPOINT:
-    case IMPDEP1:
-    case IMPDEP2:
-      // Reserved. Decide what to do later.
-      break;
+    DecodedMethod *method = _ResolveMethod(klass, ins.a);
+    if (method == nullptr && ins.opcode == INVOKEVIRTUAL)
+    {
+      throw std::runtime_error("java.lang.NoSuchMethodError: java/lang/Object." + *kRef.name);
+    }
+    if (method == nullptr)
+    {
+      // Object.<init>, only the receiver has to go.
+      ins.opcode = POP;
+      return;
+    }
+
+    // b counts the operands taken off the stack. a is set if some of them
+    // have to be spread out first, it is one past where the first
+    // parameter sits. The parser rejects every superclass but
+    // java/lang/Object, so a virtual call always lands in the class it
+    // names.
+    const MethodSignature &kSignature = method->Signature();
+    const bool kReceiver = ins.opcode != INVOKESTATIC;
+    ins.quick.method = method;
+    ins.a = kSignature.HasWideParams() ? 1 + kReceiver : 0;
+    ins.b = static_cast<int32_t>(kSignature.Params().size()) + kReceiver;
+    ins.opcode = method->Synchronized() ? INVOKE_SYNCHRONIZED : INVOKE_QUICK;
+    return;
+  }
 
+  // Field and static access, the field is looked up in its owner.
+  const ConstantPool::MemberRef kRef = klass.Pool().Member(ins.a);
+  Layout &layout = _Link(_ResolveKlass(kRef.klass));
+
+  const bool kStatic = ins.opcode == GETSTATIC || ins.opcode == PUTSTATIC;
+  const std::size_t kPos = layout.klass->FindField(kRef.name, kRef.descriptor);
+  if (kPos == MemberIndex::kNotFound || layout.statics[kPos] != kStatic)
+  {
+    throw std::runtime_error("java.lang.NoSuchFieldError: " + *layout.klass->Name() + "." + *kRef.name);
+  }
+
+  const uint16_t kSlot = layout.slots[kPos];
+  switch (ins.opcode)
+  {
+    case GETSTATIC:
+      ins.quick.slot = &layout.staticValues[kSlot];
+      ins.opcode = GETSTATIC_QUICK;
+      break;
+    case PUTSTATIC:
+      ins.quick.slot = &layout.staticValues[kSlot];
+      ins.opcode = PUTSTATIC_QUICK;
+      break;
+    case GETFIELD:
+      ins.a = kSlot;
+      ins.opcode = GETFIELD_QUICK;
+      break;
+    case PUTFIELD:
+      ins.a = kSlot;
+      ins.opcode = PUTFIELD_QUICK;
+      break;
     default:
-      throw std::invalid_argument("Invalid opcode");
+      throw std::invalid_argument("Cannot quicken opcode");
+  }
+}
+
+const CppDuke::Klass &CppDuke::VirtualMachine::Interpreter::_ResolveKlass(const Symbol name)
+{
+  const Klass *klass = _loader.Load(name, _klasses);
+  if (klass == nullptr)
+  {
+    throw std::runtime_error("java.lang.NoClassDefFoundError: " + *name);
   }
 
-  i += 1;
+  return *klass;
 }
 
-void CppDuke::VirtualMachine::Interpreter::_ExecMethod(const std::vector<uint8_t> &byteCode,
-                                                       const uint16_t bufferSize,
-                                                       const int kParams)
+CppDuke::VirtualMachine::Layout &CppDuke::VirtualMachine::Interpreter::_Link(const Klass &klass)
 {
-  Frame caller{bufferSize};
-  if (!_frames.empty() && kParams > 0)
+  std::lock_guard<std::mutex> guard{_program.lock};
+  auto itr = _program.layouts.find(&klass);
+  if (itr != std::end(_program.layouts))
   {
-    Frame &callee = _frames.top();
-    for (int i = kParams - 1; i >= 0; i--)
-    {
-      caller.Set(i, callee.Pop());
-    }
+    return itr->second;
+  }
+
+  // Superclass fields are not laid out, only java.lang.Object is supported
+  // as a superclass.
+  Layout layout{&klass, {}, {}, {}, {}, std::make_unique<Object>(&klass)};
+  for (const ConstantPool::CommonRef &f: klass.Fields())
+  {
+    const Value kZero = _Zero(*klass.SymbolAt(f.DescIndex()));
+    const bool kStatic = f.Flags() & 0x0008;
+    std::vector<Value> &values = kStatic ? layout.staticValues : layout.defaults;
+
+    layout.slots.push_back(static_cast<uint16_t>(values.size()));
+    layout.statics.push_back(kStatic);
+    values.push_back(kZero);
   }
 
-  _frames.emplace(caller);
-  std::cout << "Executing "
-            << byteCode.size() - 1
-            << " instructions with "
-            << kParams << "\n";
+  return _program.layouts.emplace(&klass, std::move(layout)).first->second;
+}
 
-  int i = 0;
-  std::any rval;
-  while (i < byteCode.size())
+void CppDuke::VirtualMachine::Interpreter::_Spread(Value *args, const MethodSignature &signature)
+{
+  // Every argument is a single operand but longs and doubles take two local
+  // slots. Moving from the last argument down never overwrites one that is
+  // still to be moved, slots are never before operands.
+  const std::vector<uint16_t> &kOffsets = signature.Offsets();
+  for (std::size_t i = kOffsets.size(); i-- > 0;)
+  {
+    args[kOffsets[i]] = args[i];
+  }
+}
+
+bool CppDuke::VirtualMachine::Interpreter::_Returns(const MethodSignature::Kind kind, const Value &v)
+{
+  switch (kind)
   {
-    _ExecOpcode(byteCode, i, rval);
+    case MethodSignature::LONG:
+      return v.Is<int64_t>();
+    case MethodSignature::FLOAT:
+      return v.Is<float>();
+    case MethodSignature::DOUBLE:
+      return v.Is<double>();
+    case MethodSignature::REFERENCE:
+      return v.Is<Object *>();
+    case MethodSignature::VOID:
+      return false;
+    default:
+      return v.Is<int32_t>();
   }
+}
 
-  _frames.pop();
-  if (rval.has_value() && !_frames.empty())
+CppDuke::VirtualMachine::Value CppDuke::VirtualMachine::Interpreter::_Zero(const std::string &desc)
+{
+  switch (desc.empty() ? 'V' : desc[0])
   {
-    _frames.top().Push(rval);
+    case 'J':
+      return Value::From<int64_t>(0);
+    case 'F':
+      return Value::From(0.0f);
+    case 'D':
+      return Value::From(0.0);
+    case 'L':
+    case '[':
+      return Value::From(nullptr);
+    default:
+      return Value::From<int32_t>(0);
   }
 }
 
-std::shared_ptr<CppDuke::ConstantPool::CodeAttribute>
-CppDuke::VirtualMachine::Interpreter::_LookupEntryPoint(const Klass& klass)
+CppDuke::VirtualMachine::DecodedMethod &
+CppDuke::VirtualMachine::Interpreter::_Decoded(const Klass &klass, const std::size_t pos)
 {
-  int i = 0, found = 0;
-  for (std::shared_ptr<ConstantPool::PoolEntry> e: klass.Pool())
+  const ConstantPool::CodeAttribute *code = klass.Codes()[pos];
+  auto itr = _decoded.find(code);
+  if (itr == std::end(_decoded))
   {
-    if (auto casted = std::dynamic_pointer_cast<ConstantPool::Utf8>(e);
-      casted
-      && casted->Data() == "([Ljava/lang/String;)V")
+    itr = _decoded.emplace(code,
+                           DecodedMethod{klass, *klass.Signatures()[pos], *code, /* fuse = */ _ngrams == 0}).first;
+
+    // ACC_SYNCHRONIZED, static ones lock the class.
+    const uint16_t kFlags = klass.Methods()[pos].Flags();
+    if (kFlags & 0x0020)
     {
-      found = 1;
-      break;
+      itr->second.Synchronize(kFlags & 0x0008 ? _Link(klass).mirror.get() : nullptr);
     }
+  }
 
-    i++;
+  return itr->second;
+}
+
+bool CppDuke::VirtualMachine::Interpreter::Run()
+{
+  const Klass *main = _loader.Load(SymbolTable::Intern(_main), _klasses);
+  if (main == nullptr)
+  {
+    fprintf(stderr, "Could not find class %s\n", _main.c_str());
+    return false;
   }
 
-  if (found)
+  const std::size_t kEntryPoint = main->GetEntryPoint();
+  if (kEntryPoint != MemberIndex::kNotFound && main->Codes()[kEntryPoint])
   {
-    for (const ConstantPool::CommonRef &m: klass.Methods())
+    const auto kStart = std::chrono::steady_clock::now();
+    _execute = _SelectExecutor();
+    if (_greenThreads)
+    {
+      _program.scheduler = std::make_unique<Scheduler>(_carriers);
+    }
+
+    // The program is over once every thread is, however main ended.
+    try
     {
-      if (m.DescIndex() == i + 1 && m.Flags() == (0x0001 | 0x0008))
+      _Invoke(_Decoded(*main, kEntryPoint), _stack.data());
+    } catch (...)
+    {
+      _UnlockAll();
+      _JoinThreads();
+      throw;
+    }
+    _JoinThreads();
+
+    for (const std::unique_ptr<Interpreter> &thread: _program.threads)
+    {
+      _executed += thread->_executed;
+      for (const auto &[key, count]: thread->_ngramCounts)
       {
-        for (const ConstantPool::CommonAttribute &attr: m.GetChildAttributes())
-        {
-          if (std::shared_ptr<ConstantPool::CodeAttribute> code = attr.GetCodeAttribute())
-          {
-            return code;
-          }
-        }
+        _ngramCounts[key] += count;
       }
     }
+
+    if (_stats)
+    {
+      const std::chrono::duration<double, std::nano> kElapsed = std::chrono::steady_clock::now() - kStart;
+      const std::chrono::duration<double, std::milli> kToMain = kStart - _launched;
+      fprintf(stderr, "Reached main in %.3f ms\n", kToMain.count());
+      fprintf(stderr,
+              "Executed %llu instructions in %.3f ms, %.2f ns per instruction\n",
+              static_cast<unsigned long long>(_executed),
+              kElapsed.count() / 1e6,
+              _executed ? kElapsed.count() / _executed : 0.0);
+      fprintf(stderr,
+              "Started %zu threads, %llu monitors inflated\n",
+              _program.threads.size(),
+              static_cast<unsigned long long>(Lock::Inflated()));
+      if (_program.scheduler)
+      {
+        const Scheduler::Stats kGreen = _program.scheduler->Report();
+        fprintf(stderr,
+                "Ran %llu green threads on %u carriers, %llu switches\n",
+                static_cast<unsigned long long>(kGreen.spawned),
+                _program.scheduler->Carriers(),
+                static_cast<unsigned long long>(kGreen.switches));
+      }
+
+      // Interpreters on other threads may still be adding to it.
+      const std::vector<const Klass *> kKlasses = _klasses.Klasses();
+      std::size_t metadata = 0;
+      for (const Klass *klass: kKlasses)
+      {
+        metadata += klass->MetadataBytes();
+      }
+      fprintf(stderr,
+              "Loaded %zu classes with %zu bytes of metadata, %zu per class\n",
+              kKlasses.size(),
+              metadata,
+              metadata / kKlasses.size());
+    }
+
+    if (_ngrams)
+    {
+      _ReportNgrams();
+    }
+  }
+  else
+  {
+    fprintf(stderr, "Could not find entry point in class %s\n", _main.c_str());
+    return false;
   }
 
-  return nullptr;
+  return true;
 }
 
-void CppDuke::VirtualMachine::Interpreter::Run()
+void CppDuke::VirtualMachine::Interpreter::EnableStats(const std::chrono::steady_clock::time_point launched)
 {
-  Klass main = _klasses.find(_main)->second;
-  auto entryPoint = Interpreter::_LookupEntryPoint(main);
-  if (entryPoint)
+  _stats = true;
+  _launched = launched;
+}
+
+void CppDuke::VirtualMachine::Interpreter::ProfileNgrams(const std::size_t top)
+{
+  _ngrams = top;
+}
+
+void CppDuke::VirtualMachine::Interpreter::EnableTrace()
+{
+  _trace = true;
+}
+
+void CppDuke::VirtualMachine::Interpreter::EnableChecks()
+{
+  _checked = true;
+}
+
+void CppDuke::VirtualMachine::Interpreter::EnableSafepoints()
+{
+  _safepoints = true;
+}
+
+void CppDuke::VirtualMachine::Interpreter::EnableGreenThreads(const unsigned carriers)
+{
+  _greenThreads = true;
+  _carriers = carriers;
+  _safepoints = true;
+}
+
+void CppDuke::VirtualMachine::Interpreter::RequestSafepoint()
+{
+  _safepoint.store(true, std::memory_order_relaxed);
+
+  std::lock_guard<std::mutex> guard{_program.lock};
+  for (const std::unique_ptr<Interpreter> &thread: _program.threads)
   {
-    _trace.push(main);
-    _ExecMethod(entryPoint->ByteCode(), entryPoint->BufferSize(), /* Temp */ 0);
-    _trace.pop();
+    thread->_safepoint.store(true, std::memory_order_relaxed);
   }
-  else
+}
+
+void CppDuke::VirtualMachine::Interpreter::_RecordNgram(const uint8_t opcode)
+{
+  // _history holds the last three opcodes, the most recent in the low byte.
+  // A key is the sequence in its low bytes and its length in the top byte.
+  const uint64_t kSeq = (static_cast<uint64_t>(_history) << 8) | opcode;
+  for (uint64_t n = 2; n <= 4; n++)
   {
-    fprintf(stderr, "Could not find entry point in class %s\n", _main.c_str());
+    const uint64_t kMask = (uint64_t{1} << (8 * n)) - 1;
+    _ngramCounts[(n << 56) | (kSeq & kMask)]++;
+  }
+
+  _history = static_cast<uint32_t>(kSeq & 0xffffff);
+}
+
+void CppDuke::VirtualMachine::Interpreter::_ReportNgrams() const
+{
+  // Filled once, interpreters on other threads may report at the same time.
+  static const std::array<const char *, 256> names = []()
+  {
+    std::array<const char *, 256> made{};
+#define NAME(op) made[op] = #op;
+    HANDLERS(NAME)
+#undef NAME
+    return made;
+  }();
+
+  for (uint64_t n = 2; n <= 4; n++)
+  {
+    std::vector<std::pair<uint64_t, uint64_t>> seqs;
+    uint64_t total = 0;
+    for (const auto &[key, count]: _ngramCounts)
+    {
+      if (key >> 56 == n)
+      {
+        seqs.emplace_back(key, count);
+        total += count;
+      }
+    }
+
+    const std::size_t kTop = std::min(_ngrams, seqs.size());
+    std::partial_sort(std::begin(seqs),
+                      std::begin(seqs) + kTop,
+                      std::end(seqs),
+                      [](const auto &l, const auto &r) { return l.second > r.second; });
+
+    fprintf(stderr, "Top %zu %llu-grams:\n", kTop, static_cast<unsigned long long>(n));
+    for (std::size_t i = 0; i < kTop; i++)
+    {
+      fprintf(stderr, "  %12llu %5.1f%% ", static_cast<unsigned long long>(seqs[i].second), 100.0 * seqs[i].second / total);
+      for (int j = static_cast<int>(n) - 1; j >= 0; j--)
+      {
+        const uint8_t kOpcode = (seqs[i].first >> (8 * j)) & 0xff;
+        fprintf(stderr, " %s", names[kOpcode] ? names[kOpcode] : "?");
+      }
+      fprintf(stderr, "\n");
+    }
   }
 }
 
@@ -1,10 +1,19 @@
 #pragma once
 
-#include <stack>
+#include <atomic>
+#include <chrono>
+#include <deque>
 #include <unordered_map>
-#include <any>
+#include <memory>
+#include <mutex>
+#include <thread>
 
+#include "decoder.hpp"
 #include "klass.hpp"
+#include "loader.hpp"
+#include "registry.hpp"
+#include "scheduler.hpp"
+#include "value.hpp"
 
 namespace CppDuke::VirtualMachine
 {
@@ -29,8 +38,13 @@ typedef enum
   BIPUSH,
   SIPUSH,
   LDC,
+  LDC_W,
+  LDC2_W,
   ILOAD = 0x15,
-  ALOAD = 0x19,
+  LLOAD,
+  FLOAD,
+  DLOAD,
+  ALOAD,
   ILOAD_0,
   ILOAD_1,
   ILOAD_2,
@@ -60,7 +74,10 @@ typedef enum
   CALOAD,
   SALOAD,
   ISTORE = 0x36,
-  ASTORE = 0x3a,
+  LSTORE,
+  FSTORE,
+  DSTORE,
+  ASTORE,
   ISTORE_0,
   ISTORE_1,
   ISTORE_2,
@@ -91,8 +108,12 @@ typedef enum
   POP = 0x57,
   POP2,
   DUP,
-  DUP2 = 0x5c,
-  SWAP = 0x5f,
+  DUP_X1,
+  DUP_X2,
+  DUP2,
+  DUP2_X1,
+  DUP2_X2,
+  SWAP,
   IADD = 0x60,
   LADD,
   FADD,
@@ -154,62 +175,307 @@ typedef enum
   DRETURN,
   ARETURN,
   RETURN,
-  PUTSTATIC = 0xb3,
-  PUTFIELD = 0xb5,
-  INVOKESPECIAL = 0xb7,
+  GETSTATIC = 0xb2,
+  PUTSTATIC,
+  GETFIELD,
+  PUTFIELD,
+  INVOKEVIRTUAL,
+  INVOKESPECIAL,
   INVOKESTATIC,
   NEW = 0xbb,
   NEWARRAY,
   ARRAYLENGTH = 0xbe,
+  MONITORENTER = 0xc2,
+  MONITOREXIT,
   IFNULL = 0xc6,
   IFNONNULL,
   GOTO_W,
   BREAKPOINT = 0xca,
+  // Superinstructions made by the decoder, numbered from the range the spec
+  // leaves unused.
+  ILOAD_ILOAD_IF_ICMPEQ = 0xcb,
+  ILOAD_ILOAD_IF_ICMPNE,
+  ILOAD_ILOAD_IF_ICMPLT,
+  ILOAD_ILOAD_IF_ICMPGE,
+  ILOAD_ILOAD_IF_ICMPGT,
+  ILOAD_ILOAD_IF_ICMPLE,
+  ILOAD_ICONST_IADD_ISTORE,
+  ILOAD_ILOAD_IALOAD,
+  IINC_GOTO,
+  // Quick forms that instructions referencing the constant pool are rewritten
+  // into once they have been resolved.
+  LDC_QUICK,
+  NEW_QUICK,
+  GETSTATIC_QUICK,
+  PUTSTATIC_QUICK,
+  GETFIELD_QUICK,
+  PUTFIELD_QUICK,
+  // Invokes with their target cached at the call site.
+  INVOKE_QUICK,
+  // Calls of synchronized methods, which lock on the way in, and their
+  // returns, which unlock on the way out.
+  INVOKE_SYNCHRONIZED,
+  IRETURN_SYNCHRONIZED,
+  RETURN_SYNCHRONIZED,
+  // java.lang.Thread, which is built in.
+  NEW_THREAD,
+  INVOKE_NATIVE,
   IMPDEP1 = 0xfe,
   IMPDEP2
 } Opcode;
 
 
+// Where the fields of a class live. Instance fields are slots in every
+// object, statics are slots owned by the layout itself. Made when the class
+// is first linked and never changed after, so pointers into it stay valid.
+struct Layout
+{
+  const Klass *klass;
+  // Slot of each field, in the order of Klass::Fields(), either in an object
+  // or in staticValues.
+  std::vector<uint16_t> slots;
+  std::vector<bool> statics;
+  // Initial values of a new object's fields.
+  std::vector<Value> defaults;
+  std::vector<Value> staticValues;
+  // Stands in for the java.lang.Class object, static synchronized methods
+  // lock it.
+  std::unique_ptr<Object> mirror;
+};
+
+// An activation record: the decoded method being executed, where it resumes
+// and a window into the interpreter's stack. Locals come first, followed by
+// the operand area. The callee's locals overlap the arguments on the
+// caller's operand area so nothing is copied on a call.
 class Frame
 {
 private:
-  std::stack<std::any> _stack;
-  std::vector<std::any> _locals;
+  const DecodedMethod *_method;
+  const Instruction *_pc;
+  Value *_locals, *_sp;
 
 public:
-  explicit Frame(uint16_t locals);
-  [[nodiscard]]
-  std::any At(int pos) const;
-  void Set(int pos, const std::any val);
-  std::any Top() const;
-  std::any Pop();
-  void Push(const std::any &item);
-  std::size_t Size() const;
+  explicit Frame(const DecodedMethod &method, Value *locals);
+  const DecodedMethod &Method() const;
+  const Klass &Owner() const;
+  Value *Locals() const;
+
+  // The dispatch loop keeps pc and sp in registers and only writes them
+  // back here when it leaves the frame.
+  const Instruction *Pc() const;
+  Value *Sp() const;
+  void Save(const Instruction *pc, Value *sp);
+};
+
+// Optional interpreter features. Every combination in use compiles to its own
+// copy of the dispatch loop, a disabled feature leaves nothing behind in it.
+template<bool _Trace, bool _Profile, bool _Checked, bool _Safepoints>
+struct Features
+{
+  // Print every instruction as it is dispatched.
+  static constexpr bool kTrace = _Trace;
+  // Count executed instructions and record n-grams.
+  static constexpr bool kProfile = _Profile;
+  // Verify operand tags and return values.
+  static constexpr bool kChecked = _Checked;
+  // Poll for safepoint requests on backward branches and calls.
+  static constexpr bool kSafepoints = _Safepoints;
 };
 
+// One execution of a program. Class metadata is shared through the registry
+// with every other interpreter, everything else is its own: decoded and
+// quickened methods, static fields, the heap and interned strings. So
+// interpreters running the same classes on several threads at once never
+// see each other.
+//
+// A java.lang.Thread the program starts runs on an OS thread in an
+// interpreter of its own, with its own stack, decoded methods and heap, that
+// shares static fields and interned strings with the one that started it.
+// Quickening stays private to a thread, so no instruction is ever rewritten
+// under another thread's feet.
+//
+// With green threads enabled, started threads are coroutines on a scheduler
+// instead, many of them taking turns on a few carriers. Calls never recurse
+// on the native stack, so a green thread suspends by leaving the dispatch
+// loop with its frames in place and resumes by entering it again. It yields
+// at safepoint polls once its quantum is up, and where it would block: on a
+// held monitor or a join, which it tries again once it is resumed.
 class Interpreter
 {
+  // What the threads of one program share, owned by the interpreter that
+  // runs main. Locked for linking and interning only, the values themselves
+  // are plain memory and threads race on them as they do in Java.
+  struct Program
+  {
+    std::mutex lock;
+    std::unordered_map<Symbol, String *> strings;
+    std::unordered_map<const Klass *, Layout> layouts;
+    // Interpreters of started threads. Kept until the program ends, others
+    // may still refer to the objects they allocated.
+    std::vector<std::unique_ptr<Interpreter>> threads;
+    // Threads not joined yet.
+    std::deque<std::thread> running;
+    // Runs started threads when they are green. Declared after threads so
+    // it stops before the interpreters its green threads run in go.
+    std::unique_ptr<Scheduler> scheduler;
+  };
+
   std::string _main;
   // TODO: Handle classes with same names from different packages.
   // Use fully qualified names?
-  std::unordered_map<std::string, Klass> _klasses;
-  std::stack<Klass> _trace;
-  std::stack<Frame> _frames;
+  // Shared, only ever added to.
+  KlassRegistry &_klasses;
+  // Brings in classes that are referenced but not loaded yet.
+  const KlassLoader &_loader;
+  std::unordered_map<const ConstantPool::CodeAttribute *, DecodedMethod> _decoded;
+
+  // Both are reserved once, a call never allocates. Java calls never recurse
+  // on the native stack, the depth is bounded by the size of _stack alone.
+  std::vector<Value> _stack;
+  std::vector<Frame> _frames;
+
+  std::unique_ptr<Program> _ownProgram;
+  Program &_program;
+
+  // Everything allocated on this thread. There is no collector yet, objects
+  // live as long as the program does.
+  std::vector<std::unique_ptr<Object>> _heap;
+  // Values loaded by LDC, quickened instructions point into it. A deque
+  // never moves what it holds as it grows.
+  std::deque<Value> _constants;
+
+  bool _stats, _trace, _checked, _safepoints, _greenThreads;
+  unsigned _carriers;
+  uint64_t _executed;
+
+  // Set from any thread, seen by the running loop on its next poll.
+  std::atomic<bool> _safepoint;
+  // True if the loop has to leave at this safepoint.
+  bool _Safepoint();
+
+  // Executed opcode sequences of length 2 to 4, keyed by the packed opcodes
+  // and their count. Only recorded when _ngrams is set.
+  std::size_t _ngrams;
+  std::chrono::steady_clock::time_point _launched;
+  uint32_t _history;
+  std::unordered_map<uint64_t, uint64_t> _ngramCounts;
+  void _RecordNgram(uint8_t opcode);
+  void _ReportNgrams() const;
+
+  template<typename _Ty, typename... _Args>
+  _Ty *_Allocate(_Args &&... args);
+  String *_Intern(Symbol s);
+
+  // Monitors held by this thread, the innermost last. Whatever is still
+  // held when an exception ends the thread is released.
+  std::vector<Object *> _monitors;
+  // Owns the monitors this thread takes, whichever OS thread it runs on.
+  const uintptr_t _self;
+  // Runs as a green thread, which yields where others would block.
+  const bool _green;
+  // False instead of blocking on a green thread.
+  bool _Lock(Object *object);
+  void _Unlock(Object *object);
+  void _UnlockAll();
+
+  // Runs thread's target in an interpreter of its own, on an OS thread or
+  // as a green thread.
+  explicit Interpreter(const Interpreter &starter, Program &program);
+  void _Start(Thread &thread);
+  void _RunThread(Thread &thread, std::size_t id);
+  Scheduler::Green _RunGreen(Thread &thread, std::size_t id);
+  // run() of a thread's target, which is its only argument.
+  const DecodedMethod &_RunMethod(const Object &target);
+  // Reports the exception being handled, which ends the thread.
+  void _Uncaught(std::size_t id);
+  // Waits for every started thread, including those started meanwhile.
+  void _JoinThreads();
+
+  // Calls the method of java.lang.Thread a call site was resolved to. False
+  // instead of blocking on a green thread.
+  bool _Native(int32_t native, Value *args);
 
   template<typename _Ty>
-  _Ty _Bitwise(const uint8_t &kOpcode);
-  bool _Cmp(const uint8_t &kOpcode);
+  static _Ty _Bitwise(const uint8_t &kOpcode, _Ty v1, Value v2);
+  static bool _Cmp(const uint8_t &kOpcode, int32_t v1, int32_t v2);
 
   template<typename _Ty>
-  _Ty _Math(const uint8_t &opcode);
+  static _Ty _Math(const uint8_t &opcode, _Ty v1, _Ty v2);
+
+  [[noreturn]] static void _Throw(const char *exception);
+
+  // The dispatch loop in the variant picked by Run(). It runs until the
+  // bottom frame returns, or until a green thread yields.
+  typedef void (Interpreter::*Executor)();
+  Executor _execute;
+  Executor _SelectExecutor() const;
+
+  template<typename _Policy>
+  void _Execute();
+  Frame &_PushFrame(const DecodedMethod &method, Value *locals);
+  // Runs method on a new frame at locals until it returns, holding its
+  // monitor if it is synchronized.
+  void _Invoke(const DecodedMethod &method, Value *locals);
+  // Decodes the method at pos in klass's Methods() on first use, methods
+  // that never run are never looked at. It must have code.
+  DecodedMethod &_Decoded(const Klass &klass, std::size_t pos);
+  // Null for methods of java.lang.Object, which is not loaded.
+  DecodedMethod *_ResolveMethod(const Klass &klass, uint16_t idx);
+  static void _Spread(Value *args, const MethodSignature &signature);
+  static bool _Returns(MethodSignature::Kind kind, const Value &v);
 
-  void _ExecOpcode(const std::vector<uint8_t> &kByteCode, int &i, std::any &rval);
-  void _ExecMethod(const std::vector<uint8_t> &byteCode, uint16_t bufferSize, const int kParams);
-  static std::shared_ptr<ConstantPool::CodeAttribute> _LookupEntryPoint(const Klass &klass);
+  // Resolves what ins refers to in klass's constant pool and rewrites it
+  // into its quick form, then points it at the quick handler.
+  void _Quicken(const Klass &klass, Instruction &ins, const void *const *handlers);
+  void _Resolve(const Klass &klass, Instruction &ins);
+  // Loads name on first use. Throws NoClassDefFoundError if it is nowhere.
+  const Klass &_ResolveKlass(Symbol name);
+  Layout &_Link(const Klass &klass);
+  static Value _Zero(const std::string &desc);
 
 public:
-  explicit Interpreter(const std::vector<Klass> &klasses, const std::string &kMain);
-  void Run();
+  // In bytes, same as -Xss.
+  static constexpr std::size_t kDefaultStackSize = 1 << 20;
+  // The least -Xss takes, 256 slots. Smaller stacks overflow within the
+  // first few calls.
+  static constexpr std::size_t kMinStackSize = 4 << 10;
+  // Green threads get at most this much, so tens of thousands of them fit.
+  static constexpr std::size_t kGreenStackSize = 16 << 10;
+
+  explicit Interpreter(KlassRegistry &klasses,
+                       const KlassLoader &loader,
+                       const std::string &kMain,
+                       std::size_t stackSize = kDefaultStackSize);
+  // False if there is no main class or entry point to run, which it
+  // reports.
+  bool Run();
+
+  // Reports executed instructions and dispatch cost once Run() returns, and
+  // how long it took from launched until main started.
+  void EnableStats(std::chrono::steady_clock::time_point launched);
+
+  // Reports the top most executed opcode sequences once Run() returns. The
+  // decoder keeps every instruction as it is so the report shows what
+  // superinstructions could be made of.
+  void ProfileNgrams(std::size_t top);
+
+  // Prints every executed instruction.
+  void EnableTrace();
+
+  // Checks operand tags and return values and raises a VerifyError instead
+  // of crashing on broken bytecode. Null references and array bounds are
+  // checked either way.
+  void EnableChecks();
+
+  // Makes the running loop poll for RequestSafepoint() on backward branches
+  // and calls.
+  void EnableSafepoints();
+  void RequestSafepoint();
+
+  // Runs the threads the program starts as green threads on carriers OS
+  // threads, one per core if zero. main keeps its own thread. Green threads
+  // yield at safepoint polls, so this enables those too.
+  void EnableGreenThreads(unsigned carriers);
 
   // Utility methods
   static bool CanInline(const ConstantPool::CodeAttribute &method);